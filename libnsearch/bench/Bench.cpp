@@ -0,0 +1,115 @@
+#include "Bench.h"
+
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <vector>
+
+static std::map< std::string, Benchmark >& Benchmarks() {
+  static std::map< std::string, Benchmark > benchmarks;
+  return benchmarks;
+}
+
+bool RegisterBenchmark( const std::string& name, const Benchmark& benchmark ) {
+  Benchmarks()[ name ] = benchmark;
+  return true;
+}
+
+// Keeps the counters from being optimized away
+static volatile size_t gCounterSum = 0;
+
+size_t CountPostings( const Database< DNA >&     db,
+                      const SequenceList< DNA >& queries ) {
+  std::vector< uint8_t > counters( db.NumSequences() );
+  SequenceIdBuffer       buffer;
+
+  size_t numCounted = 0;
+  for( auto& query : queries ) {
+    Kmers< DNA >( query, db.Seed() )
+      .ForEach( [&]( const Kmer kmer, const size_t ) {
+        const SequenceId* seqIds;
+        size_t            numSeqIds;
+        if( !db.GetSequenceIdsIncludingKmer( kmer, &seqIds, &numSeqIds,
+                                             &buffer ) )
+          return;
+
+        for( size_t i = 0; i < numSeqIds; i++ ) {
+          counters[ seqIds[ i ] ]++;
+        }
+        numCounted += numSeqIds;
+      } );
+  }
+
+  gCounterSum = std::accumulate( counters.begin(), counters.end(), size_t( 0 ) );
+  return numCounted;
+}
+
+static uint32_t NextRandom( uint32_t* random ) {
+  *random = *random * 1103515245 + 12345;
+  return *random >> 8;
+}
+
+SequenceList< DNA > RandomSequences( const size_t count, const size_t length,
+                                     uint32_t* random ) {
+  static const char Residues[] = "ACGT";
+
+  SequenceList< DNA > sequences;
+  for( size_t index = 0; index < count; index++ ) {
+    std::string residues( length, 'A' );
+    for( auto& residue : residues ) {
+      residue = Residues[ NextRandom( random ) % 4 ];
+    }
+    sequences.push_back(
+      Sequence< DNA >( "random" + std::to_string( index ), residues ) );
+  }
+  return sequences;
+}
+
+SequenceList< DNA > Mutants( const SequenceList< DNA >& templates,
+                             const size_t               numPerTemplate,
+                             const float mutationRate, uint32_t* random ) {
+  static const char Residues[] = "ACGT";
+  const uint32_t    threshold  = uint32_t( mutationRate * ( 1 << 24 ) );
+
+  SequenceList< DNA > sequences;
+  for( size_t copy = 0; copy < numPerTemplate; copy++ ) {
+    for( auto& tmpl : templates ) {
+      Sequence< DNA > mutant = tmpl;
+      mutant.identifier += "_" + std::to_string( copy );
+      for( auto& residue : mutant.sequence ) {
+        if( NextRandom( random ) < threshold ) {
+          residue = Residues[ NextRandom( random ) % 4 ];
+        }
+      }
+      sequences.push_back( std::move( mutant ) );
+    }
+  }
+  return sequences;
+}
+
+int main( int argc, const char** argv ) {
+  std::vector< std::string > names( argv + 1, argv + argc );
+  if( names.empty() ) {
+    for( auto& benchmark : Benchmarks() ) {
+      names.push_back( benchmark.first );
+    }
+  }
+
+  for( auto& name : names ) {
+    auto it = Benchmarks().find( name );
+    if( it == Benchmarks().end() ) {
+      std::cerr << "Unknown benchmark " << name << ", available:";
+      for( auto& benchmark : Benchmarks() ) {
+        std::cerr << " " << benchmark.first;
+      }
+      std::cerr << std::endl;
+      return 1;
+    }
+
+    std::cout << "== " << name << std::endl;
+    it->second();
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Database.h>
+#include <nsearch/Sequence.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/*
+ * Benchmarks register themselves by name. benchnsearch runs all of them,
+ * or the ones named on the command line, and each prints its own results.
+ * Timings are only meaningful in a Release build.
+ */
+using Benchmark = std::function< void() >;
+
+bool RegisterBenchmark( const std::string& name, const Benchmark& benchmark );
+
+// Wall clock time of block
+template < typename F >
+double Seconds( const F& block ) {
+  auto start = std::chrono::steady_clock::now();
+  block();
+  std::chrono::duration< double > elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Postings of all query kmers, counted like GlobalSearch's hit counters
+// (lookup, decoding and one counter increment per posting)
+size_t CountPostings( const Database< DNA >&     db,
+                      const SequenceList< DNA >& queries );
+
+// Sequences of random residues
+SequenceList< DNA > RandomSequences( const size_t count, const size_t length,
+                                     uint32_t* random );
+
+// numPerTemplate copies of each template, with mutationRate substitutions.
+// Mutants of the same template share most of their kmers, like the
+// sequences of a 16S reference, and make queries which hit it.
+SequenceList< DNA > Mutants( const SequenceList< DNA >& templates,
+                             const size_t               numPerTemplate,
+                             const float mutationRate, uint32_t* random );
@@ -0,0 +1,114 @@
+#include "../Bench.h"
+
+#include <nsearch/Database.h>
+#include <nsearch/Database/GlobalSearch.h>
+#include <nsearch/Database/IndexMemory.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+/*
+ * Throughput with the index arrays on regular pages, huge pages
+ * (--huge-pages) and interleaved across NUMA nodes (--numa-interleave):
+ * of counting postings (random accesses to the index, on one thread) and
+ * of whole searches (all threads at once, each with its own GlobalSearch).
+ * The index (a few hundred MB) is far larger than what the TLB covers;
+ * interleaving only makes a difference with more than one NUMA node.
+ */
+
+// Huge pages (transparent and reserved) mapped by this process, in MB
+static double HugePagesMB() {
+  double        kb = 0.0;
+  std::ifstream file( "/proc/self/smaps_rollup" );
+  std::string   key;
+  while( file >> key ) {
+    if( key == "AnonHugePages:" || key == "Private_Hugetlb:" ) {
+      double value;
+      file >> value;
+      kb += value;
+    }
+    file.ignore( std::numeric_limits< std::streamsize >::max(), '\n' );
+  }
+  return kb / 1024.0;
+}
+
+static void BenchIndexMemory() {
+  uint32_t random    = 42;
+  auto     templates = RandomSequences( 2000, 1500, &random );
+  auto     reference = Mutants( templates, 20, 0.05f, &random );
+  auto     queries   = Mutants( templates, 1, 0.05f, &random );
+  queries.resize( 300 );
+
+  const size_t numThreads =
+    std::max< size_t >( 1, std::thread::hardware_concurrency() );
+  std::cout << reference.size() << " reference sequences, " << queries.size()
+            << " queries, word size 12, " << numThreads << " threads"
+            << std::endl
+            << std::setw( 20 ) << "" << std::setw( 18 ) << "Huge pages (MB)"
+            << std::setw( 16 ) << "Counted (M/s)" << std::setw( 12 )
+            << "Queries/s" << std::endl;
+
+  struct Setup {
+    const char* name;
+    bool        hugePages, interleave;
+  };
+  const Setup setups[] = { { "default", false, false },
+                           { "--huge-pages", true, false },
+                           { "--numa-interleave", false, true },
+                           { "both", true, true } };
+
+  SearchParams< DNA > sp;
+  sp.minIdentity = 0.8f;
+
+  for( auto& setup : setups ) {
+    // Same as the command line options
+    IndexMemoryPolicy policy;
+    policy.hugePages         = setup.hugePages;
+    policy.reservedHugePages = setup.hugePages;
+    policy.interleave        = setup.interleave;
+    IndexMemory::SetPolicy( policy );
+
+    Database< DNA > db( 12 );
+    db.Initialize( reference );
+    const double hugePagesMB = HugePagesMB();
+
+    // Counting is quick, best of a few runs
+    size_t numCounted  = 0;
+    double countingSec = 0.0;
+    for( int run = 0; run < 5; run++ ) {
+      double sec =
+        Seconds( [&]() { numCounted = CountPostings( db, queries ); } );
+      countingSec = run == 0 ? sec : std::min( countingSec, sec );
+    }
+
+    double searchSec = Seconds( [&]() {
+      std::vector< std::thread > threads;
+      for( size_t thread = 0; thread < numThreads; thread++ ) {
+        threads.push_back( std::thread( [&, thread]() {
+          GlobalSearch< DNA > search( db, sp );
+          for( size_t index = thread; index < queries.size();
+               index += numThreads ) {
+            search.Query( queries[ index ] );
+          }
+        } ) );
+      }
+      for( auto& thread : threads ) {
+        thread.join();
+      }
+    } );
+
+    std::cout << std::fixed << std::setprecision( 1 ) << std::setw( 20 )
+              << setup.name << std::setw( 18 ) << hugePagesMB
+              << std::setw( 16 ) << numCounted / countingSec / 1e6
+              << std::setw( 12 ) << queries.size() / searchSec << std::endl;
+  }
+
+  IndexMemory::SetPolicy( IndexMemoryPolicy() );
+}
+
+static bool gRegistered = RegisterBenchmark( "index-memory", &BenchIndexMemory );
@@ -0,0 +1,77 @@
+#include "../Bench.h"
+
+#include <nsearch/Database.h>
+#include <nsearch/Database/GlobalSearch.h>
+
+#include <iomanip>
+#include <iostream>
+
+/*
+ * Raw vs compressed posting lists (DatabaseParams::compressPostings):
+ * memory of the postings, throughput of counting them and of whole
+ * searches.
+ */
+static size_t PostingBytes( const Database< DNA >& db ) {
+  size_t bytes = 0;
+  db.ForEachArray( [&]( const std::string& name, const size_t numBytes ) {
+    if( name == "Postings" ) {
+      bytes += numBytes;
+    }
+  } );
+  return bytes;
+}
+
+static void BenchPostingLists() {
+  uint32_t random    = 42;
+  auto     templates = RandomSequences( 500, 1500, &random );
+  auto     reference = Mutants( templates, 20, 0.05f, &random );
+  auto     queries   = Mutants( templates, 1, 0.05f, &random );
+  queries.resize( 200 );
+
+  std::cout << reference.size() << " reference sequences, " << queries.size()
+            << " queries" << std::endl;
+
+  SearchParams< DNA > sp;
+  sp.minIdentity = 0.8f;
+
+  for( size_t wordSize : { 8, 12 } ) {
+    std::cout << std::endl
+              << "Word size " << wordSize << std::endl
+              << std::setw( 14 ) << "" << std::setw( 14 ) << "Postings (MB)"
+              << std::setw( 18 ) << "Counted (M/s)" << std::setw( 16 )
+              << "Queries/s" << std::endl;
+
+    for( bool compressed : { false, true } ) {
+      DatabaseParams params;
+      params.compressPostings = compressed;
+
+      Database< DNA > db( wordSize, params );
+      db.Initialize( reference );
+
+      // Counting is quick, best of a few runs
+      size_t numCounted  = 0;
+      double countingSec = 0.0;
+      for( int run = 0; run < 5; run++ ) {
+        double sec =
+          Seconds( [&]() { numCounted = CountPostings( db, queries ); } );
+        countingSec = run == 0 ? sec : std::min( countingSec, sec );
+      }
+
+      GlobalSearch< DNA > search( db, sp );
+      double searchSec = Seconds( [&]() {
+        for( auto& query : queries ) {
+          search.Query( query );
+        }
+      } );
+
+      std::cout << std::fixed << std::setprecision( 1 ) << std::setw( 14 )
+                << ( compressed ? "compressed" : "raw" ) << std::setw( 14 )
+                << PostingBytes( db ) / 1e6 << std::setw( 18 )
+                << numCounted / countingSec / 1e6 << std::setw( 16 )
+                << queries.size() / searchSec << std::endl;
+    }
+  }
+}
+
+static bool gRegistered =
+  RegisterBenchmark( "posting-lists", &BenchPostingLists );
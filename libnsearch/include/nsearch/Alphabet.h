@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 template < typename Alphabet >
 struct BitMapPolicy {
   static const size_t NumBits = 0;
@@ -28,3 +31,19 @@ struct ScorePolicy {
     return MatchPolicy< Alphabet >::Match( chA, chB ) ? 1 : -1;
   }
 };
+
+// How residues are stored in the database, NumBits per residue.
+// Residues which can't be packed are kept aside as exceptions.
+template < typename Alphabet >
+struct PackPolicy {
+  static const size_t NumBits = 8;
+
+  inline static bool Pack( const char ch, uint8_t* code ) {
+    *code = ( uint8_t ) ch;
+    return true;
+  }
+
+  inline static char Unpack( const uint8_t code ) {
+    return ( char ) code;
+  }
+};
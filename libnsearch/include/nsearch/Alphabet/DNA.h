@@ -26,6 +26,27 @@ struct BitMapPolicy< DNA > {
   }
 };
 
+// 2 bits per base, anything but ACGT (e.g. IUPAC codes) is an exception
+template <>
+struct PackPolicy< DNA > {
+  static const size_t NumBits = 2;
+
+  inline static bool Pack( const char base, uint8_t* code ) {
+    switch( base ) {
+      case 'A': *code = 0b00; return true;
+      case 'C': *code = 0b01; return true;
+      case 'T': *code = 0b10; return true;
+      case 'G': *code = 0b11; return true;
+      default: return false;
+    }
+  }
+
+  inline static char Unpack( const uint8_t code ) {
+    static const char Bases[] = { 'A', 'C', 'T', 'G' };
+    return Bases[ code ];
+  }
+};
+
 template <>
 struct ComplementPolicy< DNA > {
   inline static char Complement( const char nuc ) {
@@ -22,11 +22,10 @@ public:
     // Output with fixed precision (sticky)
     out << std::setiosflags( std::ios::fixed );
 
-    // Header
-    static bool wroteHeader = false;
-    if( !wroteHeader ) {
+    // Header, once per output
+    if( !mWroteHeader ) {
       out << "QueryId,TargetId,QueryMatchStart,QueryMatchEnd,TargetMatchStart,TargetMatchEnd,QueryMatchSeq,TargetMatchSeq,NumColumns,NumMatches,NumMismatches,NumGaps,Identity,Alignment" << std::endl;
-      wroteHeader = true;
+      mWroteHeader = true;
     }
 
     // Each hit gets a line
@@ -159,6 +158,8 @@ private:
   static inline bool IsHitOnOtherStrand( const Hit< Alphabet >& hit ) {
     return false;
   }
+
+  bool mWroteHeader = false;
 };
 
 template <>
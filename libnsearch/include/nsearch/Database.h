@@ -1,18 +1,92 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
 #include <vector>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include "Sequence.h"
 #include "Utils.h"
 
+#include "Database/DustMasker.h"
 #include "Database/HSP.h"
 #include "Database/Highscore.h"
+#include "Database/IndexArray.h"
+#include "Database/IndexFile.h"
 #include "Database/Kmers.h"
+#include "Database/Minimizers.h"
+#include "Database/OffsetTable.h"
+#include "Database/PostingListCodec.h"
+#include "Database/SequenceStore.h"
 
 #include "Alphabet.h"
 
-using SequenceId = uint32_t; // SequenceId
+using SequenceId       = uint32_t; // SequenceId
+using SequenceIdBuffer = std::vector< SequenceId >;
+
+struct DatabaseParams {
+  // Store posting lists bit-packed: 5-7x less memory for the postings, but
+  // counting them (decoding included) takes 1.5-2.5x longer, which shows
+  // most with short words. See benchnsearch posting-lists.
+  bool compressPostings = false;
+
+  // Spaced seed, e.g. "11011011" (empty: contiguous words).
+  // Its weight (number of 1s) takes the place of the kmer length.
+  std::string seedMask;
+
+  // Index each kmer together with its reverse complement (DNA only,
+  // symmetric seeds only), so one lookup covers both strands.
+  // Postings then hold seqId << 1 | 1 if the sequence contains
+  // the reverse complement of the canonical kmer, seqId << 1 otherwise.
+  bool canonicalKmers = false;
+
+  // Only index the minimizer of every window of this many consecutive
+  // kmers (0: index every kmer). Queries are sampled the same way.
+  size_t minimizerWindow = 0;
+
+  // Kmers found in more than this fraction of the sequences are dropped
+  // from the index (stoplist), 0 keeps all. Such kmers (e.g. conserved
+  // regions) make up most of the counting work but hardly discriminate.
+  double maxKmerFrequency = 0.0;
+
+  // Mask low-complexity regions (DUST, DNA only) of database sequences
+  // and queries, so they are neither indexed nor used as seeds
+  bool dustMask = false;
+
+  // Index identical sequences only once (the first one). The others are
+  // its duplicates, reported along with it whenever it is hit.
+  bool collapseDuplicates = false;
+
+  // Store sequences ordered by length (ids are assigned in that order),
+  // so a search can skip all sequences of unsuitable length at once
+  bool sortByLength = false;
+
+  // Store sequences sharing kmers next to each other (ordered by MinHash
+  // sketch), so the hit counters of a query's candidates are close
+  // together in memory. Can't be combined with sortByLength.
+  bool clusterSequences = false;
+};
+
+// Memory of Database::ForEachIndexedKmer, reused from sequence to sequence
+template < typename Alphabet >
+struct KmerBuffer {
+  MaskedRegions          masked;
+  MinimizerBuffer        minimizers;
+  DustMasker< Alphabet > dustMasker;
+};
 
 template < typename Alphabet >
 class Database {
@@ -21,49 +95,253 @@ public:
   using OnProgressCallback =
     std::function< void( ProgressType, const size_t, const size_t ) >;
 
-  Database( const size_t kmerLength );
+  Database( const size_t          kmerLength,
+            const DatabaseParams& params = DatabaseParams() );
 
   void SetProgressCallback( const OnProgressCallback& progressCallback );
+
+  // Number of threads used to build the index (-1: all cores)
+  void SetNumThreads( const int numThreads );
+
   void Initialize( const SequenceList< Alphabet >& sequences );
 
+  // Takes over sequences and frees them once they are packed (before
+  // indexing), so the full list and the index are never held at once
+  void Initialize( SequenceList< Alphabet >&& sequences );
+
+  // Add sequences without rebuilding the index. They go to a small delta
+  // segment (ids continue after the existing ones), which is searched
+  // alongside the main index until it is merged into it.
+  void Append( const SequenceList< Alphabet >& sequences );
+
+  // Rebuild the main index including the delta segment
+  void Merge();
+
+  size_t NumAppendedSequences() const;
+
+  // Persist the index, so it can be loaded (memory-mapped) without rebuilding.
+  // Appended sequences are merged into the saved index. Load always checks
+  // that offsets, postings and ids stay within their arrays. Verifying the
+  // checksum catches any other damage, but reads the whole file, so it is
+  // only done on request.
+  bool Save( const std::string& pathToFile ) const;
+  bool Load( const std::string& pathToFile, const bool verifyChecksum = false );
+
+  // Word length and parameters an index file was built with (cheap, the
+  // index itself is neither read nor checked)
+  static bool LoadParams( const std::string& pathToFile, size_t* kmerLength,
+                          DatabaseParams* params );
+
   size_t NumSequences() const;
   size_t MaxUniqueKmers() const;
   size_t KmerLength() const;
 
-  const Sequence< Alphabet >& GetSequenceById( const SequenceId& seqId ) const;
+  // Rough peak memory (bytes) of building an index of sequences with
+  // numResidues residues and numIdentifierChars identifier characters
+  // in total, e.g. to split a database which does not fit into memory
+  size_t EstimateMemoryUsage( const size_t numSequences,
+                              const size_t numResidues,
+                              const size_t numIdentifierChars ) const;
+
+  // Positions of a word making up the kmer
+  const SeedMask& Seed() const;
+
+  // Direct-address table for short words, sorted kmer array otherwise
+  bool IsDirectIndex() const;
+
+  const DatabaseParams& Params() const;
+
+  Sequence< Alphabet > GetSequenceById( const SequenceId& seqId ) const;
+
+  // Sequences identical to seqId which were collapsed into it
+  size_t NumDuplicates( const SequenceId& seqId ) const;
+  void   GetDuplicate( const SequenceId& seqId, const size_t index,
+                       Sequence< Alphabet >* seq ) const;
 
-  bool GetKmersForSequenceId( const SequenceId& seqId, const Kmer** kmers,
-                              size_t* numKmers ) const;
+  // Position of a duplicate in the sequences passed to Initialize,
+  // see OriginalSequenceId
+  SequenceId OriginalDuplicateId( const SequenceId& seqId,
+                                  const size_t      index ) const;
+
+  // Decode into seq, reusing its buffers
+  void GetSequenceById( const SequenceId&     seqId,
+                        Sequence< Alphabet >* seq ) const;
+
+  size_t SequenceLength( const SequenceId& seqId ) const;
+
+  // Position of seqId in the sequences passed to Initialize (differs if
+  // sequences were reordered or collapsed). Appended ones follow those,
+  // and keep their position once merged.
+  SequenceId OriginalSequenceId( const SequenceId& seqId ) const;
+
+  // Sequences of minLength to maxLength residues are [first, last).
+  // Only if sorted by length (and nothing appended), see DatabaseParams.
+  bool GetSequenceIdRangeByLength( const size_t minLength,
+                                   const size_t maxLength, SequenceId* first,
+                                   SequenceId* last ) const;
+
+  // Kmers are computed from the stored sequence (every position)
+  bool GetKmersForSequenceId( const SequenceId&    seqId,
+                              std::vector< Kmer >* kmers ) const;
+
+  // Memory (bytes) of each array of the index (appended sequences aside)
+  using ArrayCallback =
+    std::function< void( const std::string&, const size_t ) >;
+  void ForEachArray( const ArrayCallback& block ) const;
+
+  // Number of postings of every kmer in the index (canonical kmers in a
+  // canonical index), appended sequences aside
+  using PostingListCallback = std::function< void( const Kmer, const size_t ) >;
+  void ForEachPostingList( const PostingListCallback& block ) const;
+
+  // Kmers dropped for being too frequent, see DatabaseParams
+  size_t NumStopKmers() const;
+  bool   IsStopKmer( const Kmer kmer ) const;
+
+  // Regions of seq which are not indexed (or seeded, for a query)
+  void GetMaskedRegions( const Sequence< Alphabet >& seq,
+                         MaskedRegions*              regions ) const;
+  void GetMaskedRegions( const Sequence< Alphabet >& seq,
+                         MaskedRegions*              regions,
+                         DustMasker< Alphabet >*     masker ) const;
+
+  // Kmers of seq which are looked up in the index
+  // (every kmer, or only the minimizers)
+  void ForEachIndexedKmer(
+    const Sequence< Alphabet >&                 seq,
+    const typename Kmers< Alphabet >::Callback& block ) const;
+
+  // Same, reusing the memory of buffer (e.g. for every query)
+  void ForEachIndexedKmer( const Sequence< Alphabet >&                 seq,
+                           const typename Kmers< Alphabet >::Callback& block,
+                           KmerBuffer< Alphabet >* buffer ) const;
+
+  // Compressed posting lists are decoded into buffer (seqIds points into it).
+  // A canonical index is looked up by canonical kmer, see DatabaseParams.
+  bool GetSequenceIdsIncludingKmer( const Kmer& kmer, const SequenceId** seqIds,
+                                    size_t*           numSeqIds,
+                                    SequenceIdBuffer* buffer ) const;
+
+  // Uncompressed posting lists only, no appended sequences
   bool GetSequenceIdsIncludingKmer( const Kmer& kmer, const SequenceId** seqIds,
                                     size_t* numSeqIds ) const;
 
 private:
-  size_t mKmerLength;
+  using ProgressReporter = std::function< void( ProgressType ) >;
 
-  SequenceList< Alphabet > mSequences;
-  size_t                   mMaxUniqueKmers;
+  // Largest word (in bits) indexed through a direct-address table
+  static const size_t MaxDirectIndexBits = 24;
 
-  std::vector< size_t >     mSequenceIdsOffsetByKmer;
-  std::vector< size_t >     mSequenceIdsCountByKmer;
-  std::vector< SequenceId > mSequenceIds;
+  // Append merges once the delta segment exceeds 1/MaxDeltaFraction
+  // of the main index
+  static const size_t MaxDeltaFraction = 4;
 
-  std::vector< size_t > mKmerOffsetBySequenceId;
-  std::vector< size_t > mKmerCountBySequenceId;
-  std::vector< Kmer >   mKmers;
+  SeedMask       mSeed;
+  size_t         mKmerLength;
+  DatabaseParams mParams;
+
+  SequenceStore< Alphabet > mSequences;
+  size_t                    mMaxUniqueKmers;
+
+  // Kmers present in the database, sorted (only if not a direct index).
+  // The slot of a kmer is the kmer itself (direct index)
+  // or its position in this array.
+  IndexArray< Kmer > mSortedKmers;
+
+  // Posting list of each slot, in mSequenceIds
+  // (byte range in mCompressedSequenceIds if compressed)
+  OffsetTable              mSequenceIdsOffsetByKmer;
+  IndexArray< SequenceId > mSequenceIds;
+  IndexArray< uint8_t >    mCompressedSequenceIds;
+
+  // Stoplist, sorted
+  IndexArray< Kmer > mStopKmers;
+
+  // Identifiers and original ids of the duplicates of each sequence
+  // (collapseDuplicates)
+  OffsetTable              mDuplicatesBySequence;
+  IndexArray< char >       mDuplicateIdentifiers;
+  OffsetTable              mDuplicateIdentifierOffsets;
+  IndexArray< SequenceId > mDuplicateOriginalIds;
+
+  // Original id of each sequence, empty if in original order
+  IndexArray< SequenceId > mOriginalIds;
 
   OnProgressCallback mProgressCallback;
+  int                mNumThreads;
+
+  // Appended sequences, and an (uncompressed) index of them alone
+  SequenceList< Alphabet >                mDeltaSequences;
+  std::unique_ptr< Database< Alphabet > > mDelta;
+
+  // Sequences passed to Initialize (duplicates included), then the
+  // appended ones, all in their original order
+  SequenceList< Alphabet > AllSequences() const;
+  size_t                   NumInitializedSequences() const;
+
+  void Reset();
+
+  // Order in which sequences are stored (sortByLength, clusterSequences)
+  void SortSequences( SequenceList< Alphabet >*  sequences,
+                      std::vector< SequenceId >* originalIds ) const;
+
+  // Records the duplicates of each unique sequence. originalIds: id of
+  // each unique sequence in sequences (ascending), see KeepUnique.
+  void CollapseDuplicates( const SequenceList< Alphabet >& sequences,
+                           std::vector< SequenceId >*      originalIds );
+
+  // Drops all but the unique sequences in place (moving them)
+  static void KeepUnique( SequenceList< Alphabet >*        sequences,
+                          const std::vector< SequenceId >& originalIds );
+
+  // Index the (packed) sequences in mSequences
+  void Build();
+
+  void BuildDirectIndex( const std::vector< SequenceId >& rangeStart,
+                         const ProgressReporter&          reportProgress );
+  void BuildSortedIndex( const std::vector< SequenceId >& rangeStart,
+                         const ProgressReporter&          reportProgress );
+  void DropFrequentKmers( const size_t numSequences );
+  void CompressPostings( const size_t numThreads );
+
+  static bool ReadParams( const IndexFile::Reader& reader, size_t* kmerLength,
+                          DatabaseParams* params );
+
+  // Whether the arrays of a loaded index refer to each other consistently,
+  // so lookups stay within bounds (linear in the size of the index)
+  bool IsConsistent() const;
+
+  bool FindSlot( const Kmer kmer, size_t* slot ) const;
+
+  // Kmer under which a sequence's kmer is indexed, and its posting
+  Kmer IndexKey( const Kmer kmer, const SequenceId seqId,
+                 SequenceId* posting ) const;
+
+  // Doubles are stored bitwise among the index file's params
+  static uint64_t DoubleBits( const double value );
+  static double   BitsToDouble( const uint64_t bits );
+
+  static void ForEachThread( const size_t                           numThreads,
+                             const std::function< void( size_t ) >& block );
 };
 
 /*
  * Implementation
  */
 template < typename A >
-Database< A >::Database( const size_t kmerLength )
-    : mKmerLength( kmerLength ),
+Database< A >::Database( const size_t          kmerLength,
+                         const DatabaseParams& params )
+    : mSeed( params.seedMask.empty() ? SeedMask( kmerLength )
+                                     : SeedMask( params.seedMask ) ),
+      mKmerLength( mSeed.Weight() ), mParams( params ),
+      mMaxUniqueKmers( size_t( 1 )
+                       << ( BitMapPolicy< A >::NumBits * mKmerLength ) ),
       mProgressCallback( []( ProgressType, const size_t, const size_t ) {} ),
-      mMaxUniqueKmers( 1 << ( BitMapPolicy< A >::NumBits * mKmerLength ) )
-{
-  assert( BitMapPolicy< A >::NumBits * mKmerLength <= sizeof( Kmer ) * 8 );
+      mNumThreads( -1 ) {
+  assert( mSeed.Span() > 0 && mSeed.Span() <= MaxKmerLength< A >() );
+  assert( !mParams.canonicalKmers ||
+          ( KmerComplementPolicy< A >::HasComplement && mSeed.IsSymmetric() ) );
+  assert( !( mParams.sortByLength && mParams.clusterSequences ) );
 }
 
 template < typename A >
@@ -72,102 +350,1130 @@ void Database< A >::SetProgressCallback(
   mProgressCallback = progressCallback;
 }
 
+template < typename A >
+void Database< A >::SetNumThreads( const int numThreads ) {
+  mNumThreads = numThreads;
+}
+
 template < typename A >
 void Database< A >::Initialize( const SequenceList< A >& sequences ) {
-  mSequences = sequences;
+  if( mParams.sortByLength || mParams.clusterSequences ) {
+    Initialize( SequenceList< A >( sequences ) );
+    return;
+  }
 
-  size_t totalEntries       = 0;
-  size_t totalUniqueEntries = 0;
+  Reset();
 
-  /* std::vector< uint32_t > count( mMaxUniqueKmers ); */
-  std::vector< size_t >     uniqueCount( mMaxUniqueKmers );
-  std::vector< SequenceId > uniqueIndex( mMaxUniqueKmers, -1 );
+  if( !mParams.collapseDuplicates ) {
+    mSequences.Initialize( sequences );
+  } else {
+    SequenceList< A >         unique;
+    std::vector< SequenceId > originalIds;
+    CollapseDuplicates( sequences, &originalIds );
+    for( auto id : originalIds ) {
+      unique.push_back( sequences[ id ] );
+    }
+    mSequences.Initialize( unique );
+    mOriginalIds = IndexArray< SequenceId >( originalIds.size() );
+    std::copy( originalIds.begin(), originalIds.end(), mOriginalIds.data() );
+  }
 
-  for( SequenceId seqId = 0; seqId < mSequences.size(); seqId++ ) {
-    const Sequence< A >& seq = mSequences[ seqId ];
+  Build();
+}
 
-    Kmers< A > kmers( seq, mKmerLength );
-    kmers.ForEach( [&]( const Kmer kmer, const size_t pos ) {
-      totalEntries++;
+template < typename A >
+void Database< A >::Initialize( SequenceList< A >&& sequences ) {
+  Reset();
+
+  SequenceList< A >         owned( std::move( sequences ) );
+  std::vector< SequenceId > originalIds;
+  if( mParams.sortByLength || mParams.clusterSequences ) {
+    SortSequences( &owned, &originalIds );
+  }
+
+  if( mParams.collapseDuplicates ) {
+    // Representatives are moved, so the sequences exist only once
+    std::vector< SequenceId > uniqueIds;
+    CollapseDuplicates( owned, &uniqueIds );
+    KeepUnique( &owned, uniqueIds );
+
+    if( !originalIds.empty() ) {
+      for( auto& id : uniqueIds ) {
+        id = originalIds[ id ];
+      }
+      for( size_t index = 0; index < mDuplicateOriginalIds.size(); index++ ) {
+        mDuplicateOriginalIds[ index ] =
+          originalIds[ mDuplicateOriginalIds[ index ] ];
+      }
+    }
+    originalIds.swap( uniqueIds );
+  }
 
-      // Count unique words
-      if( kmer == AmbiguousKmer || uniqueIndex[ kmer ] == seqId )
-        return;
+  mOriginalIds = IndexArray< SequenceId >( originalIds.size() );
+  std::copy( originalIds.begin(), originalIds.end(), mOriginalIds.data() );
+  std::vector< SequenceId >().swap( originalIds );
+
+  mSequences.Initialize( owned );
+  SequenceList< A >().swap( owned );
+
+  // The many small sequence buffers are freed, but glibc keeps them
+  // (hardly ever reused by the few large index arrays) unless asked
+#ifdef __GLIBC__
+  malloc_trim( 0 );
+#endif
+
+  Build();
+}
+
+template < typename A >
+void Database< A >::Reset() {
+  mDeltaSequences.clear();
+  mDelta.reset();
 
-      uniqueIndex[ kmer ] = seqId;
-      uniqueCount[ kmer ]++;
-      totalUniqueEntries++;
+  mDuplicatesBySequence       = OffsetTable();
+  mDuplicateIdentifiers       = IndexArray< char >();
+  mDuplicateIdentifierOffsets = OffsetTable();
+  mDuplicateOriginalIds       = IndexArray< SequenceId >();
+  mOriginalIds                = IndexArray< SequenceId >();
+}
+
+template < typename A >
+void Database< A >::SortSequences( SequenceList< A >*         sequences,
+                                   std::vector< SequenceId >* originalIds ) const {
+  const size_t numSequences = sequences->size();
+  originalIds->resize( numSequences );
+  std::iota( originalIds->begin(), originalIds->end(), 0 );
+
+  // Stable, so identical sequences keep their order
+  if( mParams.sortByLength ) {
+    std::stable_sort( originalIds->begin(), originalIds->end(),
+                      [&]( const SequenceId left, const SequenceId right ) {
+                        return ( *sequences )[ left ].Length() <
+                               ( *sequences )[ right ].Length();
+                      } );
+  } else {
+    // MinHash sketch: the smallest hash of the sequence's kmers, under a
+    // few different hash functions. Sequences sharing many kmers likely
+    // share the first minimum (or more), and sort next to each other.
+    static const size_t   SketchSize = 3;
+    static const uint64_t Seeds[ SketchSize ] = { 0, 0x9e3779b97f4a7c15ULL,
+                                                  0xbf58476d1ce4e5b9ULL };
+
+    using Sketch = std::array< uint64_t, SketchSize >;
+    std::vector< Sketch > sketches( numSequences );
+
+    size_t numThreads = mNumThreads > 0 ? mNumThreads
+                                        : std::thread::hardware_concurrency();
+    numThreads =
+      std::max< size_t >( 1, std::min( numThreads, numSequences / 256 ) );
+
+    ForEachThread( numThreads, [&]( const size_t thread ) {
+      for( size_t seqId = thread; seqId < numSequences;
+           seqId += numThreads ) {
+        Sketch& sketch = sketches[ seqId ];
+        sketch.fill( std::numeric_limits< uint64_t >::max() );
+
+        Kmers< A >( ( *sequences )[ seqId ], mSeed )
+          .ForEach( [&]( const Kmer kmer, const size_t ) {
+            if( kmer == AmbiguousKmer )
+              return;
+
+            for( size_t i = 0; i < SketchSize; i++ ) {
+              sketch[ i ] =
+                std::min( sketch[ i ], HashKmer( kmer ^ Seeds[ i ] ) );
+            }
+          } );
+      }
     } );
 
-    // Progress
-    if( seqId % 512 == 0 || seqId + 1 == mSequences.size() ) {
-      mProgressCallback( ProgressType::StatsCollection, seqId + 1,
-                         mSequences.size() );
+    std::stable_sort( originalIds->begin(), originalIds->end(),
+                      [&]( const SequenceId left, const SequenceId right ) {
+                        return sketches[ left ] < sketches[ right ];
+                      } );
+  }
+
+  SequenceList< A > sorted;
+  for( auto id : *originalIds ) {
+    sorted.push_back( std::move( ( *sequences )[ id ] ) );
+  }
+  sequences->swap( sorted );
+}
+
+template < typename A >
+void Database< A >::CollapseDuplicates( const SequenceList< A >&   sequences,
+                                        std::vector< SequenceId >* originalIds ) {
+  const size_t numSequences = sequences.size();
+
+  // Group by hash, then compare within groups. The stable sort keeps
+  // the original order within a group, so the first sequence is kept.
+  std::vector< size_t > hashes( numSequences );
+  std::hash< std::string > hash;
+  for( size_t seqId = 0; seqId < numSequences; seqId++ ) {
+    hashes[ seqId ] = hash( sequences[ seqId ].sequence );
+  }
+
+  std::vector< SequenceId > order( numSequences );
+  std::iota( order.begin(), order.end(), 0 );
+  std::stable_sort( order.begin(), order.end(),
+                    [&]( const SequenceId left, const SequenceId right ) {
+                      return hashes[ left ] < hashes[ right ];
+                    } );
+
+  std::vector< SequenceId > representative( numSequences );
+  for( size_t first = 0; first < numSequences; ) {
+    size_t last = first;
+    while( last < numSequences &&
+           hashes[ order[ last ] ] == hashes[ order[ first ] ] )
+      last++;
+
+    for( size_t i = first; i < last; i++ ) {
+      const SequenceId seqId = order[ i ];
+      representative[ seqId ] = seqId;
+      for( size_t j = first; j < i; j++ ) {
+        const SequenceId other = order[ j ];
+        if( representative[ other ] == other &&
+            sequences[ other ].sequence == sequences[ seqId ].sequence ) {
+          representative[ seqId ] = other;
+          break;
+        }
+      }
+    }
+    first = last;
+  }
+
+  // Representatives keep their order, new ids are consecutive
+  std::vector< SequenceId > newId( numSequences );
+  originalIds->clear();
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    if( representative[ seqId ] == seqId ) {
+      newId[ seqId ] = originalIds->size();
+      originalIds->push_back( seqId );
+    }
+  }
+  const size_t numUnique = originalIds->size();
+
+  std::vector< size_t > numDuplicates( numUnique + 1 );
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    if( representative[ seqId ] != seqId ) {
+      numDuplicates[ newId[ representative[ seqId ] ] ]++;
     }
   }
 
+  const size_t totalDuplicates = numSequences - numUnique;
+  mDuplicatesBySequence.Reset( numUnique, totalDuplicates );
+  size_t offset = 0;
+  for( size_t id = 0; id <= numUnique; id++ ) {
+    mDuplicatesBySequence.Set( id, offset );
+    offset += numDuplicates[ id ];
+    numDuplicates[ id ] = 0;
+  }
+
+  // Duplicates grouped by representative
+  std::vector< SequenceId > duplicates( totalDuplicates );
+  size_t                    numIdentifierChars = 0;
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    if( representative[ seqId ] == seqId )
+      continue;
+
+    SequenceId id = newId[ representative[ seqId ] ];
+    duplicates[ mDuplicatesBySequence.Begin( id ) + numDuplicates[ id ]++ ] =
+      seqId;
+    numIdentifierChars += sequences[ seqId ].identifier.size();
+  }
+
+  mDuplicateIdentifiers = IndexArray< char >( numIdentifierChars );
+  mDuplicateIdentifierOffsets.Reset( totalDuplicates, numIdentifierChars );
+  offset = 0;
+  for( size_t index = 0; index < totalDuplicates; index++ ) {
+    const std::string& identifier = sequences[ duplicates[ index ] ].identifier;
+    mDuplicateIdentifierOffsets.Set( index, offset );
+    std::copy( identifier.begin(), identifier.end(),
+               mDuplicateIdentifiers.data() + offset );
+    offset += identifier.size();
+  }
+  mDuplicateIdentifierOffsets.Set( totalDuplicates, offset );
+
+  mDuplicateOriginalIds = IndexArray< SequenceId >( totalDuplicates );
+  std::copy( duplicates.begin(), duplicates.end(),
+             mDuplicateOriginalIds.data() );
+}
+
+template < typename A >
+void Database< A >::KeepUnique( SequenceList< A >*               sequences,
+                                const std::vector< SequenceId >& originalIds ) {
+  // Ids ascend, so no sequence is overwritten before it is moved
+  for( size_t id = 0; id < originalIds.size(); id++ ) {
+    if( originalIds[ id ] != id ) {
+      ( *sequences )[ id ] = std::move( ( *sequences )[ originalIds[ id ] ] );
+    }
+  }
+  sequences->resize( originalIds.size() );
+  sequences->shrink_to_fit();
+}
+
+template < typename A >
+void Database< A >::Build() {
+  const size_t numSequences = mSequences.NumSequences();
+
+  // Canonical postings need one bit for the strand
+  assert( !mParams.canonicalKmers ||
+          numSequences <= std::numeric_limits< SequenceId >::max() >> 1 );
+
+  // Split sequences into one contiguous range per thread, balanced by length.
+  // Each thread only ever touches its own range, and ranges are ordered,
+  // so the postings end up sorted by sequence id (same as a serial build).
+  size_t numThreads = mNumThreads > 0 ? mNumThreads
+                                      : std::thread::hardware_concurrency();
+  numThreads =
+    std::max< size_t >( 1, std::min( numThreads, numSequences / 256 ) );
+
+  size_t totalLength = 0;
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    totalLength += mSequences.Length( seqId );
+  }
+
+  // Each thread building a direct index counts into a table of all kmers.
+  // No more threads than it takes for those tables to reach the size of
+  // the postings (at most one per residue), so building takes at most
+  // about twice the memory of the index.
+  const size_t numCompressThreads = numThreads;
+  if( IsDirectIndex() ) {
+    numThreads = std::max< size_t >(
+      1, std::min( numThreads, totalLength / mMaxUniqueKmers ) );
+  }
+
+  std::vector< SequenceId > rangeStart( numThreads + 1, numSequences );
+  rangeStart[ 0 ]   = 0;
+  size_t cumulative = 0;
+  size_t range      = 1;
+  for( SequenceId seqId = 0; seqId < numSequences && range < numThreads;
+       seqId++ ) {
+    cumulative += mSequences.Length( seqId );
+    while( range < numThreads &&
+           cumulative * numThreads >= totalLength * range ) {
+      rangeStart[ range++ ] = seqId + 1;
+    }
+  }
+
+  // Progress is reported from all threads
+  std::mutex            progressMutex;
+  std::atomic< size_t > numProcessed[ 2 ];
+  numProcessed[ StatsCollection ] = 0;
+  numProcessed[ Indexing ]        = 0;
+  auto reportProgress = [&]( const ProgressType type ) {
+    size_t num = ++numProcessed[ type ];
+    if( num % 512 == 0 || num == numSequences ) {
+      std::unique_lock< std::mutex > lock( progressMutex );
+      mProgressCallback( type, num, numSequences );
+    }
+  };
+
+  mSortedKmers = IndexArray< Kmer >();
+  if( IsDirectIndex() ) {
+    BuildDirectIndex( rangeStart, reportProgress );
+  } else {
+    BuildSortedIndex( rangeStart, reportProgress );
+  }
+
+  mStopKmers = IndexArray< Kmer >();
+  if( mParams.maxKmerFrequency > 0.0 ) {
+    DropFrequentKmers( numSequences );
+  }
+
+  if( mParams.compressPostings ) {
+    CompressPostings( numCompressThreads );
+  }
+}
+
+template < typename A >
+void Database< A >::Append( const SequenceList< A >& sequences ) {
+  mDeltaSequences.insert( mDeltaSequences.end(), sequences.begin(),
+                          sequences.end() );
+
+  if( mDeltaSequences.size() * MaxDeltaFraction > mSequences.NumSequences() ) {
+    Merge();
+    return;
+  }
+
+  // The delta segment is small, so it is simply rebuilt
+  // The main index's stoplist applies to the delta, too
+  DatabaseParams deltaParams   = mParams;
+  deltaParams.compressPostings = false;
+  deltaParams.maxKmerFrequency = 0.0;
+
+  mDelta.reset( new Database< A >( mKmerLength, deltaParams ) );
+  mDelta->SetNumThreads( mNumThreads );
+  mDelta->Initialize( mDeltaSequences );
+}
+
+template < typename A >
+void Database< A >::Merge() {
+  if( mDeltaSequences.empty() )
+    return;
+
+  Initialize( AllSequences() );
+}
+
+template < typename A >
+size_t Database< A >::NumAppendedSequences() const {
+  return mDeltaSequences.size();
+}
+
+template < typename A >
+SequenceList< A > Database< A >::AllSequences() const {
+  // Rebuilding from these reorders (and collapses) them the same way
+  // again, so original ids stay the same
+  SequenceList< A > sequences( NumInitializedSequences() );
+  for( SequenceId seqId = 0; seqId < mSequences.NumSequences(); seqId++ ) {
+    GetSequenceById( seqId, &sequences[ OriginalSequenceId( seqId ) ] );
+    for( size_t index = 0; index < NumDuplicates( seqId ); index++ ) {
+      GetDuplicate( seqId, index,
+                    &sequences[ OriginalDuplicateId( seqId, index ) ] );
+    }
+  }
+  sequences.insert( sequences.end(), mDeltaSequences.begin(),
+                    mDeltaSequences.end() );
+  return sequences;
+}
+
+template < typename A >
+size_t Database< A >::NumInitializedSequences() const {
+  return mSequences.NumSequences() + ( mDuplicatesBySequence.NumEntries() > 0
+                                         ? mDuplicatesBySequence.Total()
+                                         : 0 );
+}
+
+template < typename A >
+void Database< A >::BuildDirectIndex(
+  const std::vector< SequenceId >& rangeStart,
+  const ProgressReporter&          reportProgress ) {
+  const size_t numThreads = rangeStart.size() - 1;
+
+  // Per-thread number of sequences including each kmer,
+  // later turned into each thread's write cursor within a posting list
+  std::vector< std::vector< uint32_t > > countByThread( numThreads );
+  std::vector< size_t > totalUniqueEntriesByThread( numThreads );
+
+  // A canonical kmer can occur in both orientations within one sequence,
+  // each is a separate posting
+  const size_t strandBits = mParams.canonicalKmers ? 1 : 0;
+
+  // Words of a sequence are seen (a bit per word and strand) until the
+  // next sequence, a few MB per thread at most. The ones set are unset
+  // through the sequence's unique words.
+  auto unsee = []( std::vector< bool >* seen, std::vector< size_t >* unique ) {
+    for( auto word : *unique ) {
+      ( *seen )[ word ] = false;
+    }
+    unique->clear();
+  };
+
+  ForEachThread( numThreads, [&]( const size_t thread ) {
+    auto& uniqueCount = countByThread[ thread ];
+    uniqueCount.resize( mMaxUniqueKmers );
+    std::vector< bool >   seen( mMaxUniqueKmers << strandBits );
+    std::vector< size_t > unique;
+    Sequence< A >         seq;
+    KmerBuffer< A >       buffer;
+
+    size_t totalUniqueEntries = 0;
+    for( SequenceId seqId = rangeStart[ thread ];
+         seqId < rangeStart[ thread + 1 ]; seqId++ ) {
+      mSequences.Get( seqId, &seq );
+      ForEachIndexedKmer( seq, [&]( const Kmer kmer, const size_t ) {
+        if( kmer == AmbiguousKmer )
+          return;
+
+        // Count unique words
+        SequenceId posting;
+        Kmer       key  = IndexKey( kmer, seqId, &posting );
+        size_t     word = ( key << strandBits ) | ( posting & strandBits );
+        if( seen[ word ] )
+          return;
+
+        seen[ word ] = true;
+        unique.push_back( word );
+        uniqueCount[ key ]++;
+      }, &buffer );
+      totalUniqueEntries += unique.size();
+      unsee( &seen, &unique );
+
+      reportProgress( ProgressType::StatsCollection );
+    }
+    totalUniqueEntriesByThread[ thread ] = totalUniqueEntries;
+  } );
+
   // Calculate indices
-  mSequenceIdsOffsetByKmer.resize( mMaxUniqueKmers );
-  for( size_t i = 0; i < mMaxUniqueKmers; i++ ) {
-    mSequenceIdsOffsetByKmer[ i ] =
-      i > 0 ? mSequenceIdsOffsetByKmer[ i - 1 ] + uniqueCount[ i - 1 ] : 0;
+  size_t totalUniqueEntries =
+    std::accumulate( totalUniqueEntriesByThread.begin(),
+                     totalUniqueEntriesByThread.end(), size_t( 0 ) );
+  mSequenceIdsOffsetByKmer.Reset( mMaxUniqueKmers, totalUniqueEntries );
+
+  size_t offset = 0;
+  for( size_t kmer = 0; kmer < mMaxUniqueKmers; kmer++ ) {
+    mSequenceIdsOffsetByKmer.Set( kmer, offset );
+
+    uint32_t count = 0;
+    for( auto& uniqueCount : countByThread ) {
+      uint32_t threadCount = uniqueCount[ kmer ];
+      uniqueCount[ kmer ]  = count;
+      count += threadCount;
+    }
+    offset += count;
   }
+  mSequenceIdsOffsetByKmer.Set( mMaxUniqueKmers, offset );
 
   // Populate DB
-  mSequenceIds.resize( totalUniqueEntries );
-  mKmers.resize( totalEntries );
+  mSequenceIds = IndexArray< SequenceId >( totalUniqueEntries );
 
-  // Reset to 0
-  mSequenceIdsCountByKmer = std::vector< size_t >( mMaxUniqueKmers );
-  mKmerCountBySequenceId  = std::vector< size_t >( mSequences.size() );
-  mKmerOffsetBySequenceId = std::vector< size_t >( mSequences.size() );
+  ForEachThread( numThreads, [&]( const size_t thread ) {
+    auto&                 cursor = countByThread[ thread ];
+    std::vector< bool >   seen( mMaxUniqueKmers << strandBits );
+    std::vector< size_t > unique;
+    Sequence< A >         seq;
+    KmerBuffer< A >       buffer;
 
-  uniqueIndex = std::vector< SequenceId >( mMaxUniqueKmers, -1 );
+    auto seqIdsData = mSequenceIds.data();
 
-  auto   kmersData = mKmers.data();
-  size_t kmerCount = 0;
+    for( SequenceId seqId = rangeStart[ thread ];
+         seqId < rangeStart[ thread + 1 ]; seqId++ ) {
+      mSequences.Get( seqId, &seq );
+      ForEachIndexedKmer( seq, [&]( const Kmer kmer, const size_t ) {
+        if( kmer == AmbiguousKmer )
+          return;
 
-  for( SequenceId seqId = 0; seqId < mSequences.size(); seqId++ ) {
-    const Sequence< A >& seq = mSequences[ seqId ];
+        SequenceId posting;
+        Kmer       key  = IndexKey( kmer, seqId, &posting );
+        size_t     word = ( key << strandBits ) | ( posting & strandBits );
+        if( seen[ word ] )
+          return;
 
-    mKmerOffsetBySequenceId[ seqId ] = kmerCount;
+        seen[ word ] = true;
+        unique.push_back( word );
 
-    Kmers< A > kmers( seq, mKmerLength );
-    kmers.ForEach( [&]( const Kmer kmer, const size_t pos ) {
-      // Encode position in kmersData implicitly
-      // by saving _every_ kmer
-      kmersData[ kmerCount++ ] = kmer;
+        SequenceId* list = seqIdsData + mSequenceIdsOffsetByKmer.Begin( key );
+        size_t      num  = ++cursor[ key ];
+        list[ num - 1 ]  = posting;
 
-      if( kmer == AmbiguousKmer || uniqueIndex[ kmer ] == seqId )
-        return;
+        // Keep postings sorted if the reverse orientation came first
+        if( num > 1 && list[ num - 2 ] > posting ) {
+          std::swap( list[ num - 2 ], list[ num - 1 ] );
+        }
+      }, &buffer );
+      unsee( &seen, &unique );
 
-      uniqueIndex[ kmer ] = seqId;
+      reportProgress( ProgressType::Indexing );
+    }
+  } );
+}
 
-      mSequenceIds[ mSequenceIdsOffsetByKmer[ kmer ] +
-                    mSequenceIdsCountByKmer[ kmer ] ] = seqId;
-      mSequenceIdsCountByKmer[ kmer ]++;
-    } );
+template < typename A >
+void Database< A >::BuildSortedIndex(
+  const std::vector< SequenceId >& rangeStart,
+  const ProgressReporter&          reportProgress ) {
+  const size_t numThreads = rangeStart.size() - 1;
+
+  struct Entry {
+    Kmer       kmer;
+    SequenceId seqId; // posting
+
+    bool operator<( const Entry& other ) const {
+      return kmer < other.kmer || ( kmer == other.kmer && seqId < other.seqId );
+    }
+    bool operator==( const Entry& other ) const {
+      return kmer == other.kmer && seqId == other.seqId;
+    }
+  };
+
+  // Distinct (kmer, sequence) pairs of each thread's range, sorted
+  std::vector< std::vector< Entry > > entriesByThread( numThreads );
+  std::vector< std::vector< Kmer > >  kmersByThread( numThreads );
+
+  ForEachThread( numThreads, [&]( const size_t thread ) {
+    auto&           entries = entriesByThread[ thread ];
+    Sequence< A >   seq;
+    KmerBuffer< A > buffer;
+    for( SequenceId seqId = rangeStart[ thread ];
+         seqId < rangeStart[ thread + 1 ]; seqId++ ) {
+      mSequences.Get( seqId, &seq );
+      ForEachIndexedKmer( seq, [&]( const Kmer kmer, const size_t ) {
+        if( kmer == AmbiguousKmer )
+          return;
 
-    mKmerCountBySequenceId[ seqId ] =
-      kmerCount - mKmerOffsetBySequenceId[ seqId ];
+        SequenceId posting;
+        Kmer       key = IndexKey( kmer, seqId, &posting );
+        entries.push_back( { key, posting } );
+      }, &buffer );
 
-    // Progress
-    if( seqId % 512 == 0 || seqId + 1 == mSequences.size() ) {
-      mProgressCallback( ProgressType::Indexing, seqId + 1, mSequences.size() );
+      reportProgress( ProgressType::StatsCollection );
     }
+
+    std::sort( entries.begin(), entries.end() );
+    entries.erase( std::unique( entries.begin(), entries.end() ),
+                   entries.end() );
+
+    auto& kmers = kmersByThread[ thread ];
+    for( auto& entry : entries ) {
+      if( kmers.empty() || kmers.back() != entry.kmer )
+        kmers.push_back( entry.kmer );
+    }
+  } );
+
+  // All kmers in the database
+  std::vector< Kmer > sortedKmers;
+  for( auto& kmers : kmersByThread ) {
+    std::vector< Kmer > merged;
+    std::set_union( sortedKmers.begin(), sortedKmers.end(), kmers.begin(),
+                    kmers.end(), std::back_inserter( merged ) );
+    sortedKmers.swap( merged );
+    std::vector< Kmer >().swap( kmers );
+  }
+
+  mSortedKmers = IndexArray< Kmer >( sortedKmers.size() );
+  std::copy( sortedKmers.begin(), sortedKmers.end(), mSortedKmers.data() );
+  std::vector< Kmer >().swap( sortedKmers );
+
+  // Calculate indices. Threads cover ascending sequence ranges,
+  // so appending them in order keeps each posting list sorted.
+  const size_t            numSlots = mSortedKmers.size();
+  std::vector< uint32_t > cursor( numSlots );
+  size_t                  totalEntries = 0;
+  for( auto& entries : entriesByThread ) {
+    size_t slot = 0;
+    for( auto& entry : entries ) {
+      while( mSortedKmers[ slot ] != entry.kmer )
+        slot++;
+      cursor[ slot ]++;
+    }
+    totalEntries += entries.size();
+  }
+
+  mSequenceIdsOffsetByKmer.Reset( numSlots, totalEntries );
+  size_t offset = 0;
+  for( size_t slot = 0; slot < numSlots; slot++ ) {
+    mSequenceIdsOffsetByKmer.Set( slot, offset );
+    offset += cursor[ slot ];
+    cursor[ slot ] = 0;
+  }
+  mSequenceIdsOffsetByKmer.Set( numSlots, offset );
+
+  // Populate DB
+  mSequenceIds = IndexArray< SequenceId >( totalEntries );
+  for( size_t thread = 0; thread < numThreads; thread++ ) {
+    auto&  entries = entriesByThread[ thread ];
+    size_t slot    = 0;
+    for( auto& entry : entries ) {
+      while( mSortedKmers[ slot ] != entry.kmer )
+        slot++;
+      mSequenceIds[ mSequenceIdsOffsetByKmer.Begin( slot ) +
+                    cursor[ slot ]++ ] = entry.seqId;
+    }
+    std::vector< Entry >().swap( entries );
+
+    mProgressCallback( ProgressType::Indexing, rangeStart[ thread + 1 ],
+                       mSequences.NumSequences() );
   }
 }
 
 template < typename A >
-const Sequence< A >&
-Database< A >::GetSequenceById( const SequenceId& seqId ) const {
+void Database< A >::DropFrequentKmers( const size_t numSequences ) {
+  const size_t maxCount = std::max< size_t >(
+    1, size_t( mParams.maxKmerFrequency * numSequences ) );
+  const size_t numSlots = mSequenceIdsOffsetByKmer.NumEntries();
+
+  std::vector< Kmer > stopKmers;
+  size_t              totalEntries = 0;
+  for( size_t slot = 0; slot < numSlots; slot++ ) {
+    size_t count = mSequenceIdsOffsetByKmer.Count( slot );
+    if( count > maxCount ) {
+      stopKmers.push_back( IsDirectIndex() ? Kmer( slot )
+                                           : mSortedKmers[ slot ] );
+    } else {
+      totalEntries += count;
+    }
+  }
+
+  if( stopKmers.empty() )
+    return;
+
+  // Compact the remaining posting lists
+  OffsetTable              offsets;
+  IndexArray< SequenceId > sequenceIds( totalEntries );
+  offsets.Reset( numSlots, totalEntries );
+
+  size_t offset = 0;
+  for( size_t slot = 0; slot < numSlots; slot++ ) {
+    offsets.Set( slot, offset );
+
+    size_t count = mSequenceIdsOffsetByKmer.Count( slot );
+    if( count > maxCount )
+      continue;
+
+    auto begin = mSequenceIds.data() + mSequenceIdsOffsetByKmer.Begin( slot );
+    std::copy( begin, begin + count, sequenceIds.data() + offset );
+    offset += count;
+  }
+  offsets.Set( numSlots, offset );
+
+  mSequenceIdsOffsetByKmer = std::move( offsets );
+  mSequenceIds             = std::move( sequenceIds );
+
+  mStopKmers = IndexArray< Kmer >( stopKmers.size() );
+  std::copy( stopKmers.begin(), stopKmers.end(), mStopKmers.data() );
+}
+
+template < typename A >
+void Database< A >::CompressPostings( const size_t numThreads ) {
+  const size_t numSlots = mSequenceIdsOffsetByKmer.NumEntries();
+
+  auto slotRange = [&]( const size_t thread, size_t* first, size_t* last ) {
+    *first = numSlots * thread / numThreads;
+    *last  = numSlots * ( thread + 1 ) / numThreads;
+  };
+
+  auto encodedSize = [&]( const size_t slot ) -> size_t {
+    size_t count = mSequenceIdsOffsetByKmer.Count( slot );
+    if( count == 0 )
+      return 0;
+
+    return PostingListCodec::EncodedSize(
+      mSequenceIds.data() + mSequenceIdsOffsetByKmer.Begin( slot ), count );
+  };
+
+  // Size of each encoded list
+  std::vector< size_t > numBytes( numSlots );
+  ForEachThread( numThreads, [&]( const size_t thread ) {
+    size_t first, last;
+    slotRange( thread, &first, &last );
+    for( size_t slot = first; slot < last; slot++ ) {
+      numBytes[ slot ] = encodedSize( slot );
+    }
+  } );
+
+  OffsetTable byteOffsets;
+  size_t      totalBytes =
+    std::accumulate( numBytes.begin(), numBytes.end(), size_t( 0 ) );
+  byteOffsets.Reset( numSlots, totalBytes );
+
+  size_t offset = 0;
+  for( size_t slot = 0; slot < numSlots; slot++ ) {
+    byteOffsets.Set( slot, offset );
+    offset += numBytes[ slot ];
+  }
+  byteOffsets.Set( numSlots, offset );
+
+  mCompressedSequenceIds =
+    IndexArray< uint8_t >( totalBytes + PostingListCodec::Padding, 0 );
+  ForEachThread( numThreads, [&]( const size_t thread ) {
+    size_t first, last;
+    slotRange( thread, &first, &last );
+    for( size_t slot = first; slot < last; slot++ ) {
+      size_t count = mSequenceIdsOffsetByKmer.Count( slot );
+      if( count == 0 )
+        continue;
+
+      PostingListCodec::Encode(
+        mSequenceIds.data() + mSequenceIdsOffsetByKmer.Begin( slot ), count,
+        mCompressedSequenceIds.data() + byteOffsets.Begin( slot ) );
+    }
+  } );
+
+  mSequenceIdsOffsetByKmer = std::move( byteOffsets );
+  mSequenceIds             = IndexArray< SequenceId >();
+}
+
+template < typename A >
+void Database< A >::ForEachThread(
+  const size_t numThreads, const std::function< void( size_t ) >& block ) {
+  std::vector< std::thread > threads;
+  for( size_t thread = 1; thread < numThreads; thread++ ) {
+    threads.push_back( std::thread( block, thread ) );
+  }
+
+  // Current thread does its share, too
+  block( 0 );
+
+  for( auto& thread : threads ) {
+    thread.join();
+  }
+}
+
+template < typename A >
+uint64_t Database< A >::DoubleBits( const double value ) {
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  return bits;
+}
+
+template < typename A >
+double Database< A >::BitsToDouble( const uint64_t bits ) {
+  double value;
+  memcpy( &value, &bits, sizeof( value ) );
+  return value;
+}
+
+template < typename A >
+bool Database< A >::Save( const std::string& pathToFile ) const {
+  if( !mDeltaSequences.empty() ) {
+    Database< A > merged( mKmerLength, mParams );
+    merged.SetNumThreads( mNumThreads );
+    merged.Initialize( AllSequences() );
+    return merged.Save( pathToFile );
+  }
+
+  IndexFile::Writer writer( pathToFile, BitMapPolicy< A >::NumBits );
+
+  std::vector< uint64_t > params = { mKmerLength, mParams.compressPostings,
+                                     mSeed.CareBits(), mSeed.Span(),
+                                     mParams.canonicalKmers,
+                                     mParams.minimizerWindow,
+                                     DoubleBits( mParams.maxKmerFrequency ),
+                                     mParams.dustMask,
+                                     mParams.collapseDuplicates,
+                                     mParams.sortByLength,
+                                     mParams.clusterSequences };
+  writer.Add( params );
+
+  mSequences.Write( &writer );
+
+  // Index
+  writer.Add( mSortedKmers );
+  writer.Add( mSequenceIdsOffsetByKmer.Narrow() );
+  writer.Add( mSequenceIdsOffsetByKmer.Wide() );
+  writer.Add( mSequenceIds );
+  writer.Add( mCompressedSequenceIds );
+  writer.Add( mStopKmers );
+  writer.Add( mDuplicatesBySequence.Narrow() );
+  writer.Add( mDuplicatesBySequence.Wide() );
+  writer.Add( mDuplicateIdentifiers );
+  writer.Add( mDuplicateIdentifierOffsets.Narrow() );
+  writer.Add( mDuplicateIdentifierOffsets.Wide() );
+  writer.Add( mDuplicateOriginalIds );
+  writer.Add( mOriginalIds );
+
+  return writer.Close();
+}
+
+template < typename A >
+bool Database< A >::Load( const std::string& pathToFile,
+                          const bool         verifyChecksum ) {
+  IndexFile::Reader reader( pathToFile, verifyChecksum );
+  size_t            kmerLength;
+  DatabaseParams    dbParams;
+  if( !ReadParams( reader, &kmerLength, &dbParams ) )
+    return false;
+
+  // Everything stays in the mapped file
+  Database< A > db( kmerLength, dbParams );
+  if( !db.mSequences.Read( reader, 1 ) )
+    return false;
+
+  size_t section = 1 + SequenceStore< A >::NumSections;
+  if( !reader.Get( section++, &db.mSortedKmers ) ||
+      !reader.Get( section++, &db.mSequenceIdsOffsetByKmer.Narrow() ) ||
+      !reader.Get( section++, &db.mSequenceIdsOffsetByKmer.Wide() ) ||
+      !reader.Get( section++, &db.mSequenceIds ) ||
+      !reader.Get( section++, &db.mCompressedSequenceIds ) ||
+      !reader.Get( section++, &db.mStopKmers ) ||
+      !reader.Get( section++, &db.mDuplicatesBySequence.Narrow() ) ||
+      !reader.Get( section++, &db.mDuplicatesBySequence.Wide() ) ||
+      !reader.Get( section++, &db.mDuplicateIdentifiers ) ||
+      !reader.Get( section++, &db.mDuplicateIdentifierOffsets.Narrow() ) ||
+      !reader.Get( section++, &db.mDuplicateIdentifierOffsets.Wide() ) ||
+      !reader.Get( section++, &db.mDuplicateOriginalIds ) ||
+      !reader.Get( section++, &db.mOriginalIds ) ||
+      db.mSequenceIdsOffsetByKmer.NumEntries() !=
+        ( db.IsDirectIndex() ? db.mMaxUniqueKmers : db.mSortedKmers.size() ) )
+    return false;
+
+  if( dbParams.collapseDuplicates &&
+      ( db.mDuplicatesBySequence.NumEntries() != db.NumSequences() ||
+        db.mDuplicateIdentifierOffsets.NumEntries() !=
+          db.mDuplicatesBySequence.Total() ||
+        db.mDuplicateOriginalIds.size() != db.mDuplicatesBySequence.Total() ) )
+    return false;
+
+  if( !db.mOriginalIds.empty() &&
+      db.mOriginalIds.size() != db.NumSequences() )
+    return false;
+
+  db.mNumThreads = mNumThreads;
+  if( !db.IsConsistent() )
+    return false;
+
+  if( dbParams.sortByLength ) {
+    for( SequenceId seqId = 1; seqId < db.NumSequences(); seqId++ ) {
+      if( db.SequenceLength( seqId ) < db.SequenceLength( seqId - 1 ) )
+        return false;
+    }
+  }
+
+  db.mProgressCallback = mProgressCallback;
+  *this                = std::move( db );
+  return true;
+}
+
+template < typename A >
+bool Database< A >::LoadParams( const std::string& pathToFile,
+                                size_t* kmerLength, DatabaseParams* params ) {
+  IndexFile::Reader reader( pathToFile, false );
+  return ReadParams( reader, kmerLength, params );
+}
+
+template < typename A >
+bool Database< A >::ReadParams( const IndexFile::Reader& reader,
+                                size_t* kmerLength, DatabaseParams* params ) {
+  if( !reader.IsValid() || reader.AlphabetBits() != BitMapPolicy< A >::NumBits )
+    return false;
+
+  IndexArray< uint64_t > values;
+  if( !reader.Get( 0, &values ) || values.size() < 11 )
+    return false;
+
+  SeedMask seed( values[ 2 ], values[ 3 ] );
+  if( seed.Span() == 0 || seed.Span() > MaxKmerLength< A >() ||
+      seed.Weight() != values[ 0 ] )
+    return false;
+
+  if( values[ 4 ] && ( !KmerComplementPolicy< A >::HasComplement ||
+                       !seed.IsSymmetric() ) )
+    return false;
+
+  *kmerLength                = values[ 0 ];
+  params->compressPostings   = values[ 1 ];
+  params->seedMask           = seed.ToString();
+  params->canonicalKmers     = values[ 4 ];
+  params->minimizerWindow    = values[ 5 ];
+  params->maxKmerFrequency   = BitsToDouble( values[ 6 ] );
+  params->dustMask           = values[ 7 ];
+  params->collapseDuplicates = values[ 8 ];
+  params->sortByLength       = values[ 9 ];
+  params->clusterSequences   = values[ 10 ];
+  return true;
+}
+
+template < typename A >
+bool Database< A >::IsConsistent() const {
+  // Kmers are looked up by binary search
+  for( size_t slot = 1; slot < mSortedKmers.size(); slot++ ) {
+    if( mSortedKmers[ slot ] <= mSortedKmers[ slot - 1 ] )
+      return false;
+  }
+  if( !std::is_sorted( mStopKmers.data(),
+                       mStopKmers.data() + mStopKmers.size() ) )
+    return false;
+
+  // Postings index the hit counters of a query. They are most of the work,
+  // so each thread checks a range of slots.
+  const size_t limit = mSequences.NumSequences()
+                       << ( mParams.canonicalKmers ? 1 : 0 );
+  const size_t numSlots    = mSequenceIdsOffsetByKmer.NumEntries();
+  const size_t postingsSize = mParams.compressPostings
+                               ? mCompressedSequenceIds.size()
+                               : mSequenceIds.size();
+  const size_t padding = mParams.compressPostings ? PostingListCodec::Padding
+                                                  : 0;
+  if( postingsSize < padding ||
+      !mSequenceIdsOffsetByKmer.IsValid( postingsSize - padding ) )
+    return false;
+
+  size_t numThreads = mNumThreads > 0 ? mNumThreads
+                                      : std::thread::hardware_concurrency();
+  numThreads =
+    std::max< size_t >( 1, std::min( numThreads, numSlots / 4096 ) );
+
+  std::vector< char > validByThread( numThreads, true );
+  ForEachThread( numThreads, [&]( const size_t thread ) {
+    const size_t first = numSlots * thread / numThreads;
+    const size_t last  = numSlots * ( thread + 1 ) / numThreads;
+
+    if( mParams.compressPostings ) {
+      for( size_t slot = first; slot < last; slot++ ) {
+        size_t count = mSequenceIdsOffsetByKmer.Count( slot );
+        if( count > 0 && !PostingListCodec::IsValid(
+                           mCompressedSequenceIds.data() +
+                             mSequenceIdsOffsetByKmer.Begin( slot ),
+                           count, limit ) ) {
+          validByThread[ thread ] = false;
+          return;
+        }
+      }
+      return;
+    }
+
+    const size_t begin      = mSequenceIdsOffsetByKmer.Begin( first );
+    const size_t end        = mSequenceIdsOffsetByKmer.Begin( last );
+    SequenceId   maxPosting = 0;
+    for( size_t index = begin; index < end; index++ ) {
+      maxPosting = std::max( maxPosting, mSequenceIds[ index ] );
+    }
+    validByThread[ thread ] = begin == end || maxPosting < limit;
+  } );
+
+  if( std::count( validByThread.begin(), validByThread.end(), false ) > 0 )
+    return false;
+
+  if( !mDuplicatesBySequence.IsValid( mDuplicateOriginalIds.size() ) ||
+      !mDuplicateIdentifierOffsets.IsValid( mDuplicateIdentifiers.size() ) )
+    return false;
+
+  // Original ids index the input order, duplicates included
+  const size_t numInitialized = NumInitializedSequences();
+  for( auto ids : { &mOriginalIds, &mDuplicateOriginalIds } ) {
+    for( size_t index = 0; index < ids->size(); index++ ) {
+      if( ( *ids )[ index ] >= numInitialized )
+        return false;
+    }
+  }
+
+  return true;
+}
+
+template < typename A >
+Sequence< A > Database< A >::GetSequenceById( const SequenceId& seqId ) const {
+  Sequence< A > seq;
+  GetSequenceById( seqId, &seq );
+  return seq;
+}
+
+template < typename A >
+void Database< A >::GetSequenceById( const SequenceId& seqId,
+                                     Sequence< A >*    seq ) const {
   assert( seqId < NumSequences() );
-  return mSequences[ seqId ];
+  if( seqId >= mSequences.NumSequences() ) {
+    mDelta->GetSequenceById( seqId - mSequences.NumSequences(), seq );
+    return;
+  }
+
+  mSequences.Get( seqId, seq );
+}
+
+template < typename A >
+size_t Database< A >::SequenceLength( const SequenceId& seqId ) const {
+  assert( seqId < NumSequences() );
+  if( seqId >= mSequences.NumSequences() )
+    return mDelta->SequenceLength( seqId - mSequences.NumSequences() );
+
+  return mSequences.Length( seqId );
+}
+
+template < typename A >
+SequenceId Database< A >::OriginalSequenceId( const SequenceId& seqId ) const {
+  assert( seqId < NumSequences() );
+  if( seqId >= mSequences.NumSequences() ) {
+    // After all sequences given to Initialize, duplicates included
+    return NumInitializedSequences() +
+           mDelta->OriginalSequenceId( seqId - mSequences.NumSequences() );
+  }
+
+  return mOriginalIds.empty() ? seqId : mOriginalIds[ seqId ];
+}
+
+template < typename A >
+bool Database< A >::GetSequenceIdRangeByLength( const size_t minLength,
+                                                const size_t maxLength,
+                                                SequenceId*  first,
+                                                SequenceId*  last ) const {
+  if( !mParams.sortByLength || mDelta )
+    return false;
+
+  // First sequence with more than length residues
+  auto upperBound = [&]( const size_t length ) {
+    SequenceId low = 0, high = mSequences.NumSequences();
+    while( low < high ) {
+      SequenceId mid = low + ( high - low ) / 2;
+      if( mSequences.Length( mid ) <= length ) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  };
+
+  *first = minLength > 0 ? upperBound( minLength - 1 ) : 0;
+  *last  = std::max( *first, upperBound( maxLength ) );
+  return true;
+}
+
+template < typename A >
+size_t Database< A >::NumDuplicates( const SequenceId& seqId ) const {
+  assert( seqId < NumSequences() );
+  if( seqId >= mSequences.NumSequences() )
+    return mDelta ? mDelta->NumDuplicates( seqId - mSequences.NumSequences() )
+                  : 0;
+
+  return mDuplicatesBySequence.NumEntries() > 0
+           ? mDuplicatesBySequence.Count( seqId )
+           : 0;
+}
+
+template < typename A >
+void Database< A >::GetDuplicate( const SequenceId& seqId, const size_t index,
+                                  Sequence< A >* seq ) const {
+  assert( index < NumDuplicates( seqId ) );
+  if( seqId >= mSequences.NumSequences() ) {
+    mDelta->GetDuplicate( seqId - mSequences.NumSequences(), index, seq );
+    return;
+  }
+
+  // Same residues, own identifier
+  GetSequenceById( seqId, seq );
+
+  size_t duplicate = mDuplicatesBySequence.Begin( seqId ) + index;
+  size_t begin     = mDuplicateIdentifierOffsets.Begin( duplicate );
+  seq->identifier.assign( mDuplicateIdentifiers.data() + begin,
+                          mDuplicateIdentifierOffsets.Count( duplicate ) );
+}
+
+template < typename A >
+SequenceId Database< A >::OriginalDuplicateId( const SequenceId& seqId,
+                                               const size_t      index ) const {
+  assert( index < NumDuplicates( seqId ) );
+  if( seqId >= mSequences.NumSequences() ) {
+    return NumInitializedSequences() +
+           mDelta->OriginalDuplicateId( seqId - mSequences.NumSequences(),
+                                        index );
+  }
+
+  return mDuplicateOriginalIds[ mDuplicatesBySequence.Begin( seqId ) + index ];
 }
 
 template < typename A >
 size_t Database< A >::NumSequences() const {
-  return mSequences.size();
+  return mSequences.NumSequences() + ( mDelta ? mDelta->NumSequences() : 0 );
+}
+
+template < typename A >
+size_t Database< A >::EstimateMemoryUsage(
+  const size_t numSequences, const size_t numResidues,
+  const size_t numIdentifierChars ) const {
+  // Sequence store
+  size_t bytes = numResidues * PackPolicy< A >::NumBits / 8 +
+                 numIdentifierChars + numSequences * 2 * sizeof( uint64_t );
+
+  // Postings (at most one per position), minimizers keep about
+  // two of every window + 1 kmers
+  size_t numPostings = numResidues;
+  if( mParams.minimizerWindow > 1 ) {
+    numPostings = numPostings * 2 / ( mParams.minimizerWindow + 1 );
+  }
+
+  if( IsDirectIndex() ) {
+    // Offsets, plus per-thread counts while building (as many threads
+    // as Build uses)
+    const size_t numThreads = std::max< size_t >(
+      1, std::min( { size_t( std::thread::hardware_concurrency() ),
+                     numSequences / 256, numResidues / mMaxUniqueKmers } ) );
+    bytes += numPostings * sizeof( SequenceId ) +
+             mMaxUniqueKmers * sizeof( uint64_t ) +
+             numThreads * mMaxUniqueKmers * sizeof( uint32_t );
+  } else {
+    // (kmer, posting) entries are sorted before the index is laid out
+    bytes += numPostings * ( 2 * sizeof( Kmer ) + sizeof( SequenceId ) );
+  }
+
+  return bytes;
 }
 
 template < typename A >
@@ -181,34 +1487,222 @@ size_t Database< A >::KmerLength() const {
 }
 
 template < typename A >
-bool Database< A >::GetKmersForSequenceId( const SequenceId& seqId,
-                                           const Kmer**      kmers,
-                                           size_t*           numKmers ) const {
+const SeedMask& Database< A >::Seed() const {
+  return mSeed;
+}
+
+template < typename A >
+bool Database< A >::IsDirectIndex() const {
+  return BitMapPolicy< A >::NumBits * mKmerLength <= MaxDirectIndexBits;
+}
+
+template < typename A >
+const DatabaseParams& Database< A >::Params() const {
+  return mParams;
+}
+
+template < typename A >
+bool Database< A >::GetKmersForSequenceId( const SequenceId&    seqId,
+                                           std::vector< Kmer >* kmers ) const {
+  kmers->clear();
   if( seqId >= NumSequences() )
     return false;
 
-  const auto& offset = mKmerOffsetBySequenceId[ seqId ];
-  const auto& count  = mKmerCountBySequenceId[ seqId ];
+  Sequence< A > seq;
+  GetSequenceById( seqId, &seq );
+  Kmers< A >( seq, mSeed )
+    .ForEach( [&]( const Kmer kmer, const size_t ) {
+      kmers->push_back( kmer );
+    } );
+  return !kmers->empty();
+}
 
-  *kmers    = &mKmers[ offset ];
-  *numKmers = count;
-  return count > 0;
+template < typename A >
+Kmer Database< A >::IndexKey( const Kmer kmer, const SequenceId seqId,
+                              SequenceId* posting ) const {
+  if( !mParams.canonicalKmers ) {
+    *posting = seqId;
+    return kmer;
+  }
+
+  bool isReverse;
+  Kmer key = CanonicalKmer< A >( kmer, mKmerLength, &isReverse );
+  *posting = ( seqId << 1 ) | ( isReverse ? 1 : 0 );
+  return key;
+}
+
+template < typename A >
+void Database< A >::ForEachArray( const ArrayCallback& block ) const {
+  mSequences.ForEachArray( block );
+  block( "Sorted kmers", mSortedKmers.NumBytes() );
+  block( "Posting offsets", mSequenceIdsOffsetByKmer.NumBytes() );
+  block( "Postings",
+         mSequenceIds.NumBytes() + mCompressedSequenceIds.NumBytes() );
+  block( "Stop kmers", mStopKmers.NumBytes() );
+  block( "Duplicates", mDuplicatesBySequence.NumBytes() +
+                         mDuplicateIdentifiers.NumBytes() +
+                         mDuplicateIdentifierOffsets.NumBytes() +
+                         mDuplicateOriginalIds.NumBytes() );
+  block( "Original ids", mOriginalIds.NumBytes() );
+}
+
+template < typename A >
+void Database< A >::ForEachPostingList(
+  const PostingListCallback& block ) const {
+  const size_t numSlots = mSequenceIdsOffsetByKmer.NumEntries();
+  for( size_t slot = 0; slot < numSlots; slot++ ) {
+    const size_t begin = mSequenceIdsOffsetByKmer.Begin( slot );
+    if( mSequenceIdsOffsetByKmer.End( slot ) == begin )
+      continue;
+
+    const Kmer kmer = IsDirectIndex() ? Kmer( slot ) : mSortedKmers[ slot ];
+    if( mParams.compressPostings ) {
+      block( kmer, PostingListCodec::NumIds( mCompressedSequenceIds.data() +
+                                             begin ) );
+    } else {
+      block( kmer, mSequenceIdsOffsetByKmer.End( slot ) - begin );
+    }
+  }
+}
+
+template < typename A >
+size_t Database< A >::NumStopKmers() const {
+  return mStopKmers.size();
+}
+
+template < typename A >
+bool Database< A >::IsStopKmer( const Kmer kmer ) const {
+  return std::binary_search( mStopKmers.data(),
+                             mStopKmers.data() + mStopKmers.size(), kmer );
+}
+
+template < typename A >
+void Database< A >::GetMaskedRegions( const Sequence< A >& seq,
+                                      MaskedRegions*       regions ) const {
+  DustMasker< A > masker;
+  GetMaskedRegions( seq, regions, &masker );
+}
+
+template < typename A >
+void Database< A >::GetMaskedRegions( const Sequence< A >& seq,
+                                      MaskedRegions*       regions,
+                                      DustMasker< A >*     masker ) const {
+  regions->clear();
+  if( mParams.dustMask ) {
+    masker->Mask( seq, regions );
+  }
+}
+
+template < typename A >
+void Database< A >::ForEachIndexedKmer(
+  const Sequence< A >& seq, const typename Kmers< A >::Callback& block ) const {
+  KmerBuffer< A > buffer;
+  ForEachIndexedKmer( seq, block, &buffer );
+}
+
+template < typename A >
+void Database< A >::ForEachIndexedKmer(
+  const Sequence< A >& seq, const typename Kmers< A >::Callback& block,
+  KmerBuffer< A >* buffer ) const {
+  GetMaskedRegions( seq, &buffer->masked, &buffer->dustMasker );
+
+  Minimizers< A >( seq, mSeed, mParams.minimizerWindow, mParams.canonicalKmers,
+                   &buffer->masked )
+    .ForEach( block, &buffer->minimizers );
+}
+
+template < typename A >
+bool Database< A >::FindSlot( const Kmer kmer, size_t* slot ) const {
+  if( kmer == AmbiguousKmer )
+    return false;
+
+  if( IsDirectIndex() ) {
+    if( kmer >= MaxUniqueKmers() )
+      return false;
+
+    *slot = kmer;
+    return true;
+  }
+
+  auto begin = mSortedKmers.data();
+  auto end   = begin + mSortedKmers.size();
+  auto it    = std::lower_bound( begin, end, kmer );
+  if( it == end || *it != kmer )
+    return false;
+
+  *slot = it - begin;
+  return true;
+}
+
+template < typename A >
+bool Database< A >::GetSequenceIdsIncludingKmer(
+  const Kmer& kmer, const SequenceId** seqIds, size_t* numSeqIds,
+  SequenceIdBuffer* buffer ) const {
+  *numSeqIds = 0;
+
+  size_t slot;
+  bool   found = FindSlot( kmer, &slot ) &&
+               mSequenceIdsOffsetByKmer.End( slot ) >
+                 mSequenceIdsOffsetByKmer.Begin( slot );
+
+  if( found && mParams.compressPostings ) {
+    const uint8_t* data = mCompressedSequenceIds.data() +
+                          mSequenceIdsOffsetByKmer.Begin( slot );
+    size_t count = PostingListCodec::NumIds( data );
+    if( buffer->size() < count ) {
+      buffer->resize( count );
+    }
+    PostingListCodec::Decode( data, buffer->data() );
+
+    *seqIds    = buffer->data();
+    *numSeqIds = count;
+  } else if( found ) {
+    *seqIds    = mSequenceIds.data() + mSequenceIdsOffsetByKmer.Begin( slot );
+    *numSeqIds = mSequenceIdsOffsetByKmer.Count( slot );
+  }
+
+  // Postings of the delta segment follow, with their ids shifted
+  const SequenceId* deltaIds;
+  size_t            numDeltaIds;
+  if( !mDelta || IsStopKmer( kmer ) ||
+      !mDelta->GetSequenceIdsIncludingKmer( kmer, &deltaIds, &numDeltaIds ) )
+    return found;
+
+  // Decoded postings are in the buffer already (and survive the resize)
+  bool   isInBuffer = *numSeqIds > 0 && *seqIds == buffer->data();
+  size_t count      = *numSeqIds + numDeltaIds;
+  if( buffer->size() < count ) {
+    buffer->resize( count );
+  }
+  if( *numSeqIds > 0 && !isInBuffer ) {
+    std::copy( *seqIds, *seqIds + *numSeqIds, buffer->data() );
+  }
+
+  const SequenceId shift = SequenceId( mSequences.NumSequences() )
+                           << ( mParams.canonicalKmers ? 1 : 0 );
+  for( size_t i = 0; i < numDeltaIds; i++ ) {
+    ( *buffer )[ *numSeqIds + i ] = deltaIds[ i ] + shift;
+  }
+
+  *seqIds    = buffer->data();
+  *numSeqIds = count;
+  return true;
 }
 
 template < typename A >
 bool Database< A >::GetSequenceIdsIncludingKmer( const Kmer&        kmer,
                                                  const SequenceId** seqIds,
                                                  size_t* numSeqIds ) const {
-  if( kmer == AmbiguousKmer )
-    return false;
+  assert( !mParams.compressPostings && !mDelta );
 
-  if( kmer >= MaxUniqueKmers() )
+  size_t slot;
+  if( !FindSlot( kmer, &slot ) )
     return false;
 
-  const auto& offset = mSequenceIdsOffsetByKmer[ kmer ];
-  const auto& count  = mSequenceIdsCountByKmer[ kmer ];
+  size_t offset = mSequenceIdsOffsetByKmer.Begin( slot );
+  size_t count  = mSequenceIdsOffsetByKmer.End( slot ) - offset;
 
-  *seqIds    = &mSequenceIds[ offset ];
+  *seqIds    = mSequenceIds.data() + offset;
   *numSeqIds = count;
   return count > 0;
 }
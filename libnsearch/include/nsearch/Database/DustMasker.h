@@ -0,0 +1,218 @@
+#pragma once
+
+#include "Kmers.h"
+
+#include <vector>
+
+/*
+ * Symmetric DUST (Morgulis et al. 2006): finds low-complexity regions
+ * (e.g. ATATATAT...) in linear time.
+ * A stretch of triplets scores sum( c_t * (c_t - 1) / 2 ) / (#triplets - 1),
+ * c_t being how often triplet t occurs in it. Stretches within a window
+ * which score above threshold / 10 (and are not outscored by
+ * a sub-stretch) are masked.
+ */
+template < typename Alphabet >
+class DustMasker {
+public:
+  DustMasker( const int threshold = 20, const size_t window = 64 )
+      : mThreshold( threshold ), mWindow( window ) {}
+
+  // Buffers are kept, so masking one sequence after the other
+  // doesn't allocate (once grown)
+  void Mask( const Sequence< Alphabet >& seq, MaskedRegions* regions );
+
+private:
+  static const size_t NumBits     = BitMapPolicy< Alphabet >::NumBits;
+  static const size_t NumTriplets = size_t( 1 ) << ( 3 * NumBits );
+
+  struct PerfectInterval {
+    size_t start, finish;
+    int    r, l;
+  };
+
+  // Triplets of the current window (numTriplets of them in a ring buffer,
+  // starting at first), and the state of its suffix (the last numSuffix
+  // triplets) which is considered for masking
+  struct Window {
+    std::vector< uint32_t > ring;
+    size_t                  first = 0, numTriplets = 0;
+    std::vector< int >      counts, suffixCounts;
+    int                     score = 0, suffixScore = 0;
+    size_t                  numSuffix = 0;
+
+    uint32_t Triplet( const size_t index ) const {
+      return ring[ ( first + index ) % ring.size() ];
+    }
+  };
+
+  // Empty window, zeroing only the counts of the triplets in it
+  void Clear( Window* w ) const;
+  void Shift( const uint32_t triplet, Window* w ) const;
+  void FindPerfect( Window* w, const size_t start,
+                    std::vector< PerfectInterval >* perfect ) const;
+  void Save( const size_t start, std::vector< PerfectInterval >* perfect,
+             MaskedRegions* regions ) const;
+
+  int    mThreshold;
+  size_t mWindow;
+
+  Window                         mWindowState;
+  std::vector< PerfectInterval > mPerfect;
+};
+
+template < typename A >
+void DustMasker< A >::Mask( const Sequence< A >& seq,
+                            MaskedRegions*       regions ) {
+  regions->clear();
+
+  Window&                         w       = mWindowState;
+  std::vector< PerfectInterval >& perfect = mPerfect;
+  Clear( &w );
+  perfect.clear();
+
+  const uint32_t tripletMask = NumTriplets - 1;
+  const size_t   length      = seq.Length();
+
+  // numValid: length of the current stretch of unambiguous residues,
+  // ambiguous residues separate independent stretches
+  size_t   numValid = 0;
+  uint32_t triplet  = 0;
+  for( size_t i = 0; i <= length; i++ ) {
+    int8_t val = i < length ? BitMapPolicy< A >::BitMap( seq[ i ] ) : -1;
+
+    if( val >= 0 ) {
+      numValid++;
+      triplet = ( ( triplet << NumBits ) | val ) & tripletMask;
+      if( numValid < 3 )
+        continue;
+
+      // Start of the window (in residues)
+      size_t start = ( numValid > mWindow ? numValid - mWindow : 0 ) +
+                     ( i + 1 - numValid );
+      Save( start, &perfect, regions );
+      Shift( triplet, &w );
+      if( w.score * 10 > int( w.numSuffix ) * mThreshold ) {
+        FindPerfect( &w, start, &perfect );
+      }
+    } else {
+      size_t start = ( numValid + 1 > mWindow ? numValid + 1 - mWindow : 0 ) +
+                     ( i + 1 - numValid );
+      while( !perfect.empty() ) {
+        Save( start++, &perfect, regions );
+      }
+
+      numValid = 0;
+      triplet  = 0;
+      Clear( &w );
+    }
+  }
+}
+
+template < typename A >
+void DustMasker< A >::Clear( Window* w ) const {
+  if( w->counts.empty() ) {
+    w->ring.resize( mWindow );
+    w->counts.resize( NumTriplets );
+    w->suffixCounts.resize( NumTriplets );
+  }
+
+  for( size_t index = 0; index < w->numTriplets; index++ ) {
+    w->counts[ w->Triplet( index ) ]       = 0;
+    w->suffixCounts[ w->Triplet( index ) ] = 0;
+  }
+  w->first = w->numTriplets = 0;
+  w->score = w->suffixScore = 0;
+  w->numSuffix              = 0;
+}
+
+template < typename A >
+void DustMasker< A >::Shift( const uint32_t triplet, Window* w ) const {
+  if( w->numTriplets + 2 >= mWindow ) {
+    uint32_t first = w->Triplet( 0 );
+    w->first       = ( w->first + 1 ) % w->ring.size();
+    w->numTriplets--;
+    w->score -= --w->counts[ first ];
+    if( w->numSuffix > w->numTriplets ) {
+      w->numSuffix--;
+      w->suffixScore -= --w->suffixCounts[ first ];
+    }
+  }
+
+  w->ring[ ( w->first + w->numTriplets ) % w->ring.size() ] = triplet;
+  w->numTriplets++;
+  w->numSuffix++;
+  w->score += w->counts[ triplet ]++;
+  w->suffixScore += w->suffixCounts[ triplet ]++;
+
+  // Shorten the suffix until the new triplet is no longer too frequent in it
+  if( w->suffixCounts[ triplet ] * 10 > mThreshold * 2 ) {
+    uint32_t dropped;
+    do {
+      dropped = w->Triplet( w->numTriplets - w->numSuffix );
+      w->suffixScore -= --w->suffixCounts[ dropped ];
+      w->numSuffix--;
+    } while( dropped != triplet );
+  }
+}
+
+template < typename A >
+void DustMasker< A >::FindPerfect(
+  Window* w, const size_t start,
+  std::vector< PerfectInterval >* perfect ) const {
+  // perfect is sorted by start, descending. The suffix counts are extended
+  // to the triplets before the suffix, and restored afterwards.
+  std::vector< int >& counts  = w->suffixCounts;
+  const long          lastPos = long( w->numTriplets - w->numSuffix ) - 1;
+
+  int score = w->suffixScore, maxR = 0, maxL = 0;
+  for( long i = lastPos; i >= 0; i-- ) {
+    uint32_t triplet = w->Triplet( i );
+    score += counts[ triplet ]++;
+
+    int r = score, l = int( w->numTriplets - i - 1 );
+    if( r * 10 <= mThreshold * l )
+      continue;
+
+    size_t pos = 0;
+    for( ; pos < perfect->size() && ( *perfect )[ pos ].start >= i + start;
+         pos++ ) {
+      auto& p = ( *perfect )[ pos ];
+      if( maxR == 0 || p.r * maxL > maxR * p.l ) {
+        maxR = p.r;
+        maxL = p.l;
+      }
+    }
+
+    if( maxR == 0 || r * maxL >= maxR * l ) {
+      maxR = r;
+      maxL = l;
+      perfect->insert( perfect->begin() + pos,
+                       { i + start, w->numTriplets + 2 + start, r, l } );
+    }
+  }
+
+  for( long i = lastPos; i >= 0; i-- ) {
+    counts[ w->Triplet( i ) ]--;
+  }
+}
+
+template < typename A >
+void DustMasker< A >::Save( const size_t                    start,
+                            std::vector< PerfectInterval >* perfect,
+                            MaskedRegions*                  regions ) const {
+  // Intervals starting before the window are final
+  if( perfect->empty() || perfect->back().start >= start )
+    return;
+
+  auto& p = perfect->back();
+  if( !regions->empty() && p.start <= regions->back().second ) {
+    regions->back().second = std::max( regions->back().second, p.finish );
+  } else {
+    regions->push_back( { p.start, p.finish } );
+  }
+
+  while( !perfect->empty() && perfect->back().start < start ) {
+    perfect->pop_back();
+  }
+}
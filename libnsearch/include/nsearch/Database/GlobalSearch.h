@@ -7,10 +7,61 @@
 #include "../Alignment/ExtendAlign.h"
 #include "../Database.h"
 
-#include <set>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <limits>
+#include <numeric>
+#include <set>
+
+/*
+ * Hit counters, one per database sequence. A query shares at most as
+ * many distinct kmers with a target as it has kmers, so counters of the
+ * width that number needs can't overflow: 8 bits for short queries
+ * (amplicons), 16 or 32 bits for long reads and contigs.
+ */
+class HitCounters {
+public:
+  template < typename Counter >
+  std::vector< Counter >& Get();
+
+private:
+  std::vector< uint8_t >  m8;
+  std::vector< uint16_t > m16;
+  std::vector< uint32_t > m32;
+};
 
-using Counter = unsigned short;
+template <>
+inline std::vector< uint8_t >& HitCounters::Get< uint8_t >() {
+  return m8;
+}
+
+template <>
+inline std::vector< uint16_t >& HitCounters::Get< uint16_t >() {
+  return m16;
+}
+
+template <>
+inline std::vector< uint32_t >& HitCounters::Get< uint32_t >() {
+  return m32;
+}
+
+// Whether resetting the counters after a query touched numTouched of
+// them writes all numCounters: sequential writes beat scattered ones once
+// a good part of them was touched
+inline bool ResetsAllCounters( const size_t numTouched,
+                               const size_t numCounters ) {
+  return numTouched > numCounters / 8;
+}
+
+// Bytes per counter to count up to maxCount hits
+inline size_t HitCounterBytes( const size_t maxCount ) {
+  if( maxCount <= std::numeric_limits< uint8_t >::max() )
+    return 1;
+  if( maxCount <= std::numeric_limits< uint16_t >::max() )
+    return 2;
+  return 4;
+}
 
 template < typename Alphabet >
 class GlobalSearch : public Search< Alphabet > {
@@ -24,7 +75,80 @@ protected:
   void SearchForHits( const Sequence< Alphabet >&              query,
                       const SearchForHitsCallback< Alphabet >& callback );
 
-  std::vector< Counter >  mHits;
+  // A canonical index counts hits of both strands in one pass
+  void SearchForHitsOnBothStrands(
+    const Sequence< Alphabet >&              query,
+    const SearchForHitsCallback< Alphabet >& plusCallback,
+    const SearchForHitsCallback< Alphabet >& minusCallback );
+
+  void GetKmers( const Sequence< Alphabet >& seq, std::vector< Kmer >* kmers );
+
+  // Kmers to count hits with: all of them, or the sampled ones
+  // (minimizers) if the database only indexes those
+  const std::vector< Kmer >& GetIndexedKmers( const Sequence< Alphabet >& seq,
+                                              const std::vector< Kmer >& kmers );
+
+  // Target lengths compatible with minLengthRatio, see SearchParams
+  void LimitLengths( const size_t queryLength );
+
+  // Number of distinct kmers shared with each database sequence.
+  // reverseHighscore (canonical index only) gets the counts of
+  // the query's reverse complement.
+  void CountHits( const std::vector< Kmer >& kmers, Highscore* highscore,
+                  Highscore* reverseHighscore );
+
+  // CountHits with counters of this type
+  template < typename Counter >
+  void CountHitsWith( const std::vector< Kmer >& kmers, Highscore* highscore,
+                      Highscore* reverseHighscore );
+
+  // Sets mIsFirstOccurrence[ pos ] if kmers[ pos ] occurs there first
+  void MarkFirstOccurrences( const std::vector< Kmer >& kmers );
+
+  // Zero the counters touched by the last query (all of them if most were)
+  template < typename Counter >
+  static void ResetCounters( std::vector< Counter >*    counters,
+                             std::vector< SequenceId >* touchedIds );
+
+  void AlignCandidates( const Sequence< Alphabet >&              query,
+                        const std::vector< Kmer >&               kmers,
+                        const Highscore&                         highscore,
+                        const SearchForHitsCallback< Alphabet >& callback );
+
+  // Hit counters are zero between queries. Only the ones a query
+  // touched (ids in the order first counted) need to be reset,
+  // so the cost of a query doesn't grow with the database.
+  HitCounters               mHits;
+  HitCounters               mReverseHits;
+  std::vector< SequenceId > mTouchedIds;
+  std::vector< SequenceId > mReverseTouchedIds;
+
+  // Scratch of each query, allocated once: its kmers, and which of them
+  // are first occurrences. mSeenKmers (direct index, by kmer) is all
+  // false between queries, mKmerOrder (sorted index) holds positions.
+  std::vector< Kmer >   mQueryKmers;
+  std::vector< bool >   mIsFirstOccurrence;
+  std::vector< bool >   mSeenKmers;
+  std::vector< size_t > mKmerOrder;
+
+  // Candidates with the most hits (reused, see Highscore::Reset)
+  Highscore            mHighscore, mReverseHighscore;
+  Highscore::EntryList mHighscoreEntries;
+
+  SequenceIdBuffer        mSequenceIdBuffer;
+  Sequence< Alphabet >    mCandidateSeq;
+  Sequence< Alphabet >    mDuplicateSeq;
+  std::vector< Kmer >     mCandidateKmers;
+  std::vector< Kmer >     mIndexedKmers;
+  KmerBuffer< Alphabet >  mKmerBuffer;
+
+  // Targets of mMinLength to mMaxLength residues are considered. If the
+  // database is sorted by length, they are [mFirstSeqId, mLastSeqId).
+  size_t     mMinLength, mMaxLength;
+  SequenceId mFirstSeqId, mLastSeqId;
+
+  // Candidate kmers with their position, sorted
+  std::vector< std::pair< Kmer, size_t > > mCandidateKmerPositions;
   ExtendAlign< Alphabet > mExtendAlign;
   BandedAlign< Alphabet > mBandedAlign;
 };
@@ -32,54 +156,305 @@ protected:
 template < typename A >
 GlobalSearch< A >::GlobalSearch( const Database< A >&     db,
                                  const SearchParams< A >& params )
-    : Search< A >( db, params ) {
+    : Search< A >( db, params ), mHighscore( 0 ), mReverseHighscore( 0 ) {
 
 }
 
 template < typename A >
 void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
                                   const SearchForHitsCallback< A >& callback ) {
-  const size_t defaultMinHSPLength = 16;
-  const size_t maxHSPJoinDistance  = 16;
+  std::vector< Kmer >& kmers = mQueryKmers;
+  GetKmers( query, &kmers );
+  LimitLengths( query.Length() );
 
-  size_t minHSPLength = std::min( defaultMinHSPLength, query.Length() / 2 );
+  Highscore& highscore = mHighscore;
+  highscore.Reset( mParams.maxAccepts + mParams.maxRejects );
+  CountHits( GetIndexedKmers( query, kmers ), &highscore, nullptr );
 
-  // Go through each kmer, find hits
-  if( mHits.size() < mDB.NumSequences() ) {
-    mHits.resize( mDB.NumSequences() );
+  AlignCandidates( query, kmers, highscore, callback );
+}
+
+template < typename A >
+void GlobalSearch< A >::SearchForHitsOnBothStrands(
+  const Sequence< A >& query, const SearchForHitsCallback< A >& plusCallback,
+  const SearchForHitsCallback< A >& minusCallback ) {
+  if( !mDB.Params().canonicalKmers ) {
+    Search< A >::SearchForHitsOnBothStrands( query, plusCallback,
+                                             minusCallback );
+    return;
   }
 
-  // Fast counter reset
-  memset( mHits.data(), 0, sizeof( Counter ) * mHits.capacity() );
+  std::vector< Kmer >& kmers = mQueryKmers;
+  GetKmers( query, &kmers );
+  LimitLengths( query.Length() );
 
-  Highscore highscore( mParams.maxAccepts + mParams.maxRejects );
+  Highscore& highscore        = mHighscore;
+  Highscore& reverseHighscore = mReverseHighscore;
+  highscore.Reset( mParams.maxAccepts + mParams.maxRejects );
+  reverseHighscore.Reset( mParams.maxAccepts + mParams.maxRejects );
+  CountHits( GetIndexedKmers( query, kmers ), &highscore, &reverseHighscore );
 
-  auto hitsData = mHits.data();
+  AlignCandidates( query, kmers, highscore, plusCallback );
 
-  std::vector< Kmer > kmers;
-  std::vector< bool > uniqueCheck( mDB.MaxUniqueKmers(), false );
-  Kmers< A >( query, mDB.KmerLength() )
-    .ForEach( [&]( const Kmer kmer, const size_t pos ) {
-      kmers.push_back( kmer );
+  // Minus strand candidates are aligned to the reverse complement
+  const Sequence< A >& reverse = this->ReverseComplement( query );
+  GetKmers( reverse, &kmers );
+  AlignCandidates( reverse, kmers, reverseHighscore, minusCallback );
+}
 
-      if( kmer == AmbiguousKmer || uniqueCheck[ kmer ] )
-        return;
+template < typename A >
+void GlobalSearch< A >::GetKmers( const Sequence< A >& seq,
+                                  std::vector< Kmer >* kmers ) {
+  // Masked (low-complexity) regions are no seeds
+  mDB.GetMaskedRegions( seq, &mKmerBuffer.masked, &mKmerBuffer.dustMasker );
+
+  kmers->clear();
+  Kmers< A >( seq, mDB.Seed(), &mKmerBuffer.masked )
+    .ForEach( [&]( const Kmer kmer, const size_t ) {
+      kmers->push_back( kmer );
+    } );
+}
+
+template < typename A >
+const std::vector< Kmer >&
+GlobalSearch< A >::GetIndexedKmers( const Sequence< A >&       seq,
+                                    const std::vector< Kmer >& kmers ) {
+  if( mDB.Params().minimizerWindow <= 1 )
+    return kmers;
+
+  mIndexedKmers.clear();
+  mDB.ForEachIndexedKmer( seq,
+                          [&]( const Kmer kmer, const size_t ) {
+                            mIndexedKmers.push_back( kmer );
+                          },
+                          &mKmerBuffer );
+  return mIndexedKmers;
+}
+
+template < typename A >
+void GlobalSearch< A >::LimitLengths( const size_t queryLength ) {
+  mMinLength  = 0;
+  mMaxLength  = std::numeric_limits< size_t >::max();
+  mFirstSeqId = 0;
+  mLastSeqId  = mDB.NumSequences();
+
+  const float ratio = mParams.minLengthRatio;
+  if( ratio <= 0.0f || queryLength == 0 )
+    return;
+
+  // Bounds as identity is compared: float( shorter ) / float( longer )
+  mMinLength = size_t( std::ceil( queryLength * ratio ) );
+  while( mMinLength > 0 &&
+         float( mMinLength - 1 ) / float( queryLength ) >= ratio )
+    mMinLength--;
+
+  if( ratio <= 1.0f ) {
+    mMaxLength = size_t( queryLength / ratio );
+    while( float( queryLength ) / float( mMaxLength + 1 ) >= ratio )
+      mMaxLength++;
+  }
+
+  SequenceId first, last;
+  if( mDB.GetSequenceIdRangeByLength( mMinLength, mMaxLength, &first,
+                                      &last ) ) {
+    mFirstSeqId = first;
+    mLastSeqId  = last;
+  }
+}
 
-      uniqueCheck[ kmer ] = true;
+template < typename A >
+void GlobalSearch< A >::CountHits( const std::vector< Kmer >& kmers,
+                                   Highscore*                 highscore,
+                                   Highscore* reverseHighscore ) {
+  switch( HitCounterBytes( kmers.size() ) ) {
+    case 1:
+      CountHitsWith< uint8_t >( kmers, highscore, reverseHighscore );
+      break;
+    case 2:
+      CountHitsWith< uint16_t >( kmers, highscore, reverseHighscore );
+      break;
+    default:
+      CountHitsWith< uint32_t >( kmers, highscore, reverseHighscore );
+      break;
+  }
+}
 
-      size_t            numSeqIds;
-      const SequenceId* seqIds;
+template < typename A >
+template < typename Counter >
+void GlobalSearch< A >::CountHitsWith( const std::vector< Kmer >& kmers,
+                                       Highscore*                 highscore,
+                                       Highscore* reverseHighscore ) {
+  // Go through each kmer, find hits
+  std::vector< Counter >& hits        = mHits.Get< Counter >();
+  std::vector< Counter >& reverseHits = mReverseHits.Get< Counter >();
+  if( hits.size() < mDB.NumSequences() ) {
+    hits.resize( mDB.NumSequences() );
+  }
 
-      if( !mDB.GetSequenceIdsIncludingKmer( kmer, &seqIds, &numSeqIds ) )
-        return;
+  if( reverseHighscore && reverseHits.size() < mDB.NumSequences() ) {
+    reverseHits.resize( mDB.NumSequences() );
+  }
+
+  auto hitsData        = hits.data();
+  auto reverseHitsData = reverseHits.data();
+
+  const bool canonical = mDB.Params().canonicalKmers;
+
+  // Postings are sorted by id, so the ones of sequences
+  // of unsuitable length are skipped in one go
+  const bool limited = mFirstSeqId > 0 || mLastSeqId < mDB.NumSequences();
+  const SequenceId strandBits   = canonical ? 1 : 0;
+  const SequenceId firstPosting = mFirstSeqId << strandBits;
+  const SequenceId lastPosting  = mLastSeqId << strandBits;
+  auto limit = [&]( const SequenceId** seqIds, size_t* numSeqIds ) {
+    if( !limited )
+      return;
+
+    const SequenceId* end   = *seqIds + *numSeqIds;
+    const SequenceId* first = std::lower_bound( *seqIds, end, firstPosting );
+    const SequenceId* last  = std::lower_bound( first, end, lastPosting );
+    *seqIds    = first;
+    *numSeqIds = last - first;
+  };
+
+  // Only the first occurrence of each kmer counts
+  MarkFirstOccurrences( kmers );
+  const auto& isFirstOccurrence = mIsFirstOccurrence;
+
+  for( size_t pos = 0; pos < kmers.size(); pos++ ) {
+    const Kmer kmer = kmers[ pos ];
+    if( kmer == AmbiguousKmer || !isFirstOccurrence[ pos ] )
+      continue;
+
+    size_t            numSeqIds;
+    const SequenceId* seqIds;
+
+    if( !canonical ) {
+      if( !mDB.GetSequenceIdsIncludingKmer( kmer, &seqIds, &numSeqIds,
+                                            &mSequenceIdBuffer ) )
+        continue;
+      limit( &seqIds, &numSeqIds );
 
       for( size_t i = 0; i < numSeqIds; i++ ) {
         const auto& seqId   = seqIds[ i ];
         Counter     counter = ++hitsData[ seqId ];
+        if( counter == 1 ) {
+          mTouchedIds.push_back( seqId );
+        }
 
-        highscore.Set( seqId, counter );
+        highscore->Set( seqId, counter );
       }
-    } );
+      continue;
+    }
+
+    // Canonical index: the posting's strand bit tells whether the sequence
+    // contains the kmer (plus strand) or its reverse complement (minus).
+    // Palindromic kmers are both.
+    bool isReverse;
+    Kmer key = CanonicalKmer< A >( kmer, mDB.KmerLength(), &isReverse );
+    bool isPalindrome =
+      KmerComplementPolicy< A >::ReverseComplement( kmer, mDB.KmerLength() ) ==
+      kmer;
+
+    if( !mDB.GetSequenceIdsIncludingKmer( key, &seqIds, &numSeqIds,
+                                          &mSequenceIdBuffer ) )
+      continue;
+    limit( &seqIds, &numSeqIds );
+
+    for( size_t i = 0; i < numSeqIds; i++ ) {
+      const SequenceId seqId      = seqIds[ i ] >> 1;
+      const bool       sameStrand = ( seqIds[ i ] & 1 ) == isReverse;
+
+      if( sameStrand || isPalindrome ) {
+        Counter counter = ++hitsData[ seqId ];
+        if( counter == 1 ) {
+          mTouchedIds.push_back( seqId );
+        }
+        highscore->Set( seqId, counter );
+      }
+      if( reverseHighscore && ( !sameStrand || isPalindrome ) ) {
+        Counter counter = ++reverseHitsData[ seqId ];
+        if( counter == 1 ) {
+          mReverseTouchedIds.push_back( seqId );
+        }
+        reverseHighscore->Set( seqId, counter );
+      }
+    }
+  }
+
+  ResetCounters( &hits, &mTouchedIds );
+  ResetCounters( &reverseHits, &mReverseTouchedIds );
+}
+
+template < typename A >
+void GlobalSearch< A >::MarkFirstOccurrences( const std::vector< Kmer >& kmers ) {
+  mIsFirstOccurrence.assign( kmers.size(), false );
+
+  // Kmers of a direct index are small enough for a lookup table
+  if( mDB.IsDirectIndex() ) {
+    if( mSeenKmers.size() < mDB.MaxUniqueKmers() ) {
+      mSeenKmers.resize( mDB.MaxUniqueKmers() );
+    }
+
+    for( size_t pos = 0; pos < kmers.size(); pos++ ) {
+      const Kmer kmer = kmers[ pos ];
+      if( kmer >= mSeenKmers.size() ) {
+        mIsFirstOccurrence[ pos ] = kmer != AmbiguousKmer;
+        continue;
+      }
+
+      mIsFirstOccurrence[ pos ] = !mSeenKmers[ kmer ];
+      mSeenKmers[ kmer ]        = true;
+    }
+
+    // The query's kmers are the ones touched
+    for( auto kmer : kmers ) {
+      if( kmer < mSeenKmers.size() ) {
+        mSeenKmers[ kmer ] = false;
+      }
+    }
+    return;
+  }
+
+  // Otherwise (kmers can be 64-bit) by sorting the positions. Equal kmers
+  // are ordered by position, so the first occurrence comes first (a
+  // stable sort would allocate a buffer for every query)
+  mKmerOrder.resize( kmers.size() );
+  std::iota( mKmerOrder.begin(), mKmerOrder.end(), 0 );
+  std::sort( mKmerOrder.begin(), mKmerOrder.end(),
+             [&]( const size_t left, const size_t right ) {
+               return kmers[ left ] < kmers[ right ] ||
+                      ( kmers[ left ] == kmers[ right ] && left < right );
+             } );
+
+  for( size_t i = 0; i < mKmerOrder.size(); i++ ) {
+    mIsFirstOccurrence[ mKmerOrder[ i ] ] =
+      i == 0 || kmers[ mKmerOrder[ i ] ] != kmers[ mKmerOrder[ i - 1 ] ];
+  }
+}
+
+template < typename A >
+template < typename Counter >
+void GlobalSearch< A >::ResetCounters( std::vector< Counter >*    counters,
+                                       std::vector< SequenceId >* touchedIds ) {
+  if( ResetsAllCounters( touchedIds->size(), counters->size() ) ) {
+    memset( counters->data(), 0, sizeof( Counter ) * counters->size() );
+  } else {
+    for( auto seqId : *touchedIds ) {
+      ( *counters )[ seqId ] = 0;
+    }
+  }
+  touchedIds->clear();
+}
+
+template < typename A >
+void GlobalSearch< A >::AlignCandidates(
+  const Sequence< A >& query, const std::vector< Kmer >& kmers,
+  const Highscore& highscore, const SearchForHitsCallback< A >& callback ) {
+  const size_t defaultMinHSPLength = 16;
+  const size_t maxHSPJoinDistance  = 16;
+
+  size_t minHSPLength = std::min( defaultMinHSPLength, query.Length() / 2 );
 
   // For each candidate:
   // - Get HSPs,
@@ -90,25 +465,51 @@ void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
   int numHits    = 0;
   int numRejects = 0;
 
-  auto highscores = highscore.EntriesFromTopToBottom();
-
-  HitList< A > hits;
+  auto& highscores = mHighscoreEntries;
+  highscore.EntriesFromTopToBottom( &highscores );
 
   for( auto it = highscores.cbegin(); it != highscores.cend(); ++it ) {
-    const size_t         seqId        = it->id;
-    const Sequence< A >& candidateSeq = mDB.GetSequenceById( seqId );
+    const size_t seqId = it->id;
+
+    // Can't reach minIdentity (if the database is not sorted by length,
+    // these were counted, too)
+    const size_t length = mDB.SequenceLength( seqId );
+    if( length < mMinLength || length > mMaxLength )
+      continue;
+
+    // Candidate is decoded (unpacked) from the database
+    mDB.GetSequenceById( seqId, &mCandidateSeq );
+    const Sequence< A >& candidateSeq = mCandidateSeq;
+
+    // Kmers of the candidate, at every position
+    mCandidateKmers.clear();
+    Kmers< A >( candidateSeq, mDB.Seed() )
+      .ForEach( [&]( const Kmer kmer, const size_t ) {
+        mCandidateKmers.push_back( kmer );
+      } );
+
+    const Kmer*  kmers2      = mCandidateKmers.data();
+    const size_t kmers2count = mCandidateKmers.size();
+
+    // Find matching positions through binary search instead of comparing
+    // every query kmer with every candidate kmer
+    mCandidateKmerPositions.resize( kmers2count );
+    for( size_t pos2 = 0; pos2 < kmers2count; pos2++ ) {
+      mCandidateKmerPositions[ pos2 ] = { kmers2[ pos2 ], pos2 };
+    }
+    std::sort( mCandidateKmerPositions.begin(),
+               mCandidateKmerPositions.end() );
 
     std::deque< HSP > sps;
 
     for( size_t pos = 0; pos < kmers.size(); pos++ ) {
-      const Kmer* kmers2;
-      size_t      kmers2count;
-      if( !mDB.GetKmersForSequenceId( seqId, &kmers2, &kmers2count ) )
-        continue;
-
-      for( size_t pos2 = 0; pos2 < kmers2count; pos2++ ) {
-        if( kmers2[ pos2 ] != kmers[ pos ] )
-          continue;
+      auto match = std::lower_bound(
+        mCandidateKmerPositions.begin(), mCandidateKmerPositions.end(),
+        std::make_pair( kmers[ pos ], size_t( 0 ) ) );
+      for( ; match != mCandidateKmerPositions.end() &&
+             match->first == kmers[ pos ];
+           ++match ) {
+        const size_t pos2 = match->second;
 
         // Look for the start of a "diagonal" (alignment matrix), then follow it
         if( pos == 0 || pos2 == 0 || kmers[ pos - 1 ] == AmbiguousKmer ||
@@ -120,7 +521,7 @@ void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
           size_t cur2 = pos2 + 1;
           while( cur < kmers.size() && cur2 < kmers2count &&
                  kmers[ cur ] != AmbiguousKmer &&
-                 kmers2[ cur ] != AmbiguousKmer &&
+                 kmers2[ cur2 ] != AmbiguousKmer &&
                  kmers[ cur ] == kmers2[ cur2 ] ) {
             cur++;
             cur2++;
@@ -256,7 +657,16 @@ void GlobalSearch< A >::SearchForHits( const Sequence< A >&              query,
       float identity = alignment.Identity();
       if( identity >= mParams.minIdentity ) {
         accept = true;
-        callback( candidateSeq, alignment );
+        callback( candidateSeq, mDB.OriginalSequenceId( seqId ), alignment,
+                  false );
+
+        // Collapsed identical sequences share the hit
+        // (without counting as further accepts)
+        for( size_t index = 0; index < mDB.NumDuplicates( seqId ); index++ ) {
+          mDB.GetDuplicate( seqId, index, &mDuplicateSeq );
+          callback( mDuplicateSeq, mDB.OriginalDuplicateId( seqId, index ),
+                    alignment, true );
+        }
       }
     }
 
@@ -2,7 +2,17 @@
 
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <limits>
 
+/*
+ * Keeps the entries with the highest scores in a fixed number of slots.
+ * A new entry takes the first slot scoring lower than it, and on equal
+ * scores the slots decide the order of the entries, the same as a linear
+ * scan of the slots. The lowest score of every range of slots is kept in
+ * a tree over the slots, and each id knows its slot, so Set is O(log n)
+ * and large accept/reject budgets don't slow down counting.
+ */
 class Highscore {
   class Entry {
   public:
@@ -15,36 +25,72 @@ class Highscore {
   };
 
 public:
-  Highscore( const size_t numHighestEntriesToKeep ) : mLowestScore( 0 ) {
-    mEntries.resize( numHighestEntriesToKeep );
+  Highscore( const size_t numHighestEntriesToKeep ) {
+    Reset( numHighestEntriesToKeep );
   }
 
-  // score is assumed to increase for every id
+  // Start over with empty slots, keeping buffers (the id slots are
+  // cleared through the entries kept)
+  void Reset( const size_t numHighestEntriesToKeep ) {
+    for( auto& entry : mEntries ) {
+      if( entry.score > 0 ) {
+        mSlots[ entry.id ] = None;
+      }
+    }
+    mEntries.assign( numHighestEntriesToKeep, Entry() );
+
+    // Leaves past the last slot never score lower
+    mNumLeaves = 1;
+    while( mNumLeaves < numHighestEntriesToKeep ) {
+      mNumLeaves *= 2;
+    }
+    mLowestScores.assign( 2 * mNumLeaves, std::numeric_limits< size_t >::max() );
+    for( size_t slot = 0; slot < numHighestEntriesToKeep; slot++ ) {
+      mLowestScores[ mNumLeaves + slot ] = 0;
+    }
+    for( size_t node = mNumLeaves - 1; node > 0; node-- ) {
+      mLowestScores[ node ] = std::min( mLowestScores[ 2 * node ],
+                                        mLowestScores[ 2 * node + 1 ] );
+    }
+  }
+
+  // score is assumed to increase for every id (like a hit counter)
   void Set( const size_t id, const size_t score ) {
-    if( score < mLowestScore )
+    if( mEntries.empty() || score < mLowestScores[ 1 ] )
       return;
 
-    auto it = std::find_if(
-      mEntries.begin(), mEntries.end(),
-      [id]( const Entry& candidate ) { return id == candidate.id; } );
+    Slot slot = id < mSlots.size() ? mSlots[ id ] : Slot( None );
+    if( slot == None ) {
+      slot = FirstSlotScoringLower( score );
+      if( slot == None )
+        return;
 
-    if( it == mEntries.end() ) {
-      it = std::find_if(
-        mEntries.begin(), mEntries.end(),
-        [score]( const Entry& candidate ) { return score > candidate.score; } );
+      if( mEntries[ slot ].score > 0 ) {
+        mSlots[ mEntries[ slot ].id ] = None;
+      }
+      if( id >= mSlots.size() ) {
+        mSlots.resize( std::max( id + 1, 2 * mSlots.size() ), Slot( None ) );
+      }
+      mEntries[ slot ].id = id;
+      mSlots[ id ]        = slot;
     }
 
-    if( it != mEntries.end() ) {
-      it->id    = id;
-      it->score = score;
+    mEntries[ slot ].score = score;
+    UpdateLowestScores( slot );
+  }
 
-      mLowestScore =
-        std::min_element( mEntries.begin(), mEntries.end() )->score;
-    }
+  using EntryList = std::vector< Entry >;
+
+  EntryList EntriesFromTopToBottom() const {
+    EntryList sorted;
+    EntriesFromTopToBottom( &sorted );
+    return sorted;
   }
 
-  std::vector< Entry > EntriesFromTopToBottom() const {
-    std::vector< Entry > sorted = mEntries;
+  // Into sorted, reusing its memory
+  void EntriesFromTopToBottom( EntryList* entries ) const {
+    EntryList& sorted = *entries;
+    sorted.assign( mEntries.begin(), mEntries.end() );
 
     // remove empty elements
     sorted.erase(
@@ -58,10 +104,46 @@ public:
 
     // reverse
     std::reverse( sorted.begin(), sorted.end() );
-    return sorted;
   }
 
 private:
-  size_t               mLowestScore;
+  using Slot = uint32_t;
+
+  static const Slot None = std::numeric_limits< Slot >::max();
+
+  // Descends to the leftmost leaf scoring lower (None if there is none)
+  Slot FirstSlotScoringLower( const size_t score ) const {
+    if( mLowestScores[ 1 ] >= score )
+      return None;
+
+    size_t node = 1;
+    while( node < mNumLeaves ) {
+      node = mLowestScores[ 2 * node ] < score ? 2 * node : 2 * node + 1;
+    }
+    return Slot( node - mNumLeaves );
+  }
+
+  void UpdateLowestScores( const Slot slot ) {
+    size_t node           = mNumLeaves + slot;
+    mLowestScores[ node ] = mEntries[ slot ].score;
+    for( node /= 2; node > 0; node /= 2 ) {
+      size_t lowest = std::min( mLowestScores[ 2 * node ],
+                                mLowestScores[ 2 * node + 1 ] );
+      if( mLowestScores[ node ] == lowest )
+        break;
+
+      mLowestScores[ node ] = lowest;
+    }
+  }
+
+  // Entry of each slot (score 0 if empty)
   std::vector< Entry > mEntries;
+
+  // Lowest score of each node of a complete binary tree over the slots
+  // (root at 1, the leaves start at mNumLeaves)
+  size_t                mNumLeaves;
+  std::vector< size_t > mLowestScores;
+
+  // Slot of each id (None if not kept)
+  std::vector< Slot > mSlots;
 };
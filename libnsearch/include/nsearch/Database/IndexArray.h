@@ -0,0 +1,120 @@
+#pragma once
+
+#include "IndexMemory.h"
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+/*
+ * Contiguous array used for the database index.
+ * Either owns its elements (while building the index) or refers to
+ * memory owned by someone else, e.g. a memory-mapped index file.
+ * Owned elements are allocated according to the IndexMemoryPolicy.
+ */
+template < typename T >
+class IndexArray {
+public:
+  IndexArray() : mData( NULL ), mSize( 0 ) {}
+
+  IndexArray( const size_t size, const T& value = T() )
+      : mOwned( size, value ) {
+    Sync();
+  }
+
+  // Non-owning view, backing keeps the referenced memory alive
+  IndexArray( const T* data, const size_t size,
+              const std::shared_ptr< const void >& backing )
+      : mData( data ), mSize( size ), mBacking( backing ) {}
+
+  IndexArray( const IndexArray< T >& other ) {
+    *this = other;
+  }
+
+  IndexArray( IndexArray< T >&& other ) {
+    *this = std::move( other );
+  }
+
+  IndexArray< T >& operator=( const IndexArray< T >& other ) {
+    mOwned   = other.mOwned;
+    mBacking = other.mBacking;
+    if( IsOwned( other ) ) {
+      Sync();
+    } else {
+      mData = other.mData;
+      mSize = other.mSize;
+    }
+    return *this;
+  }
+
+  IndexArray< T >& operator=( IndexArray< T >&& other ) {
+    bool owned = IsOwned( other );
+    mOwned     = std::move( other.mOwned );
+    mBacking   = std::move( other.mBacking );
+    if( owned ) {
+      Sync();
+    } else {
+      mData = other.mData;
+      mSize = other.mSize;
+    }
+    other.mOwned.clear();
+    other.Sync();
+    return *this;
+  }
+
+  void resize( const size_t size, const T& value = T() ) {
+    assert( IsOwned( *this ) );
+    mOwned.resize( size, value );
+    Sync();
+  }
+
+  inline const T& operator[]( const size_t index ) const {
+    assert( index < mSize );
+    return mData[ index ];
+  }
+
+  // Writing is only allowed while the array owns its elements
+  inline T& operator[]( const size_t index ) {
+    assert( index < mSize );
+    return const_cast< T& >( mData[ index ] );
+  }
+
+  const T* data() const {
+    return mData;
+  }
+
+  T* data() {
+    return const_cast< T* >( mData );
+  }
+
+  size_t size() const {
+    return mSize;
+  }
+
+  bool empty() const {
+    return mSize == 0;
+  }
+
+  size_t NumBytes() const {
+    return mSize * sizeof( T );
+  }
+
+  bool IsMapped() const {
+    return !IsOwned( *this );
+  }
+
+private:
+  static bool IsOwned( const IndexArray< T >& array ) {
+    return array.mData == array.mOwned.data();
+  }
+
+  void Sync() {
+    mData = mOwned.data();
+    mSize = mOwned.size();
+  }
+
+  std::vector< T, IndexAllocator< T > > mOwned;
+  const T*                              mData;
+  size_t                                mSize;
+  std::shared_ptr< const void >         mBacking;
+};
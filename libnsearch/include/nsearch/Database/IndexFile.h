@@ -0,0 +1,235 @@
+#pragma once
+
+#include "../MappedFile.h"
+#include "IndexArray.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Binary on-disk format of a database index
+ *
+ * [Header][Section 0][Section 1]...[Section table]
+ *
+ * Every section is a plain array, aligned so it can be used
+ * in place once the file is memory-mapped. The checksum covers
+ * everything after the header.
+ */
+namespace IndexFile {
+
+static const char     Magic[ 8 ] = { 'N', 'S', 'E', 'A', 'R', 'C', 'H', 'X' };
+static const uint32_t Version    = 13;
+
+static const size_t SectionAlignment = 64;
+
+struct Header {
+  char     magic[ 8 ];
+  uint32_t version;
+  uint32_t alphabetBits;
+  uint64_t numSections;
+  uint64_t sectionTableOffset;
+  uint64_t checksum;
+};
+
+struct SectionEntry {
+  uint64_t offset;
+  uint64_t count;
+  uint64_t elementSize;
+};
+
+// FNV-1a, fed with 64-bit words instead of single bytes
+class Checksum {
+public:
+  Checksum() : mHash( 14695981039346656037ULL ), mNumPending( 0 ) {}
+
+  void Update( const void* data, size_t size ) {
+    const char* ptr = ( const char* ) data;
+
+    while( size > 0 && mNumPending > 0 ) {
+      mPending[ mNumPending++ ] = *ptr++;
+      size--;
+      if( mNumPending == sizeof( uint64_t ) ) {
+        Mix( mPending );
+        mNumPending = 0;
+      }
+    }
+
+    while( size >= sizeof( uint64_t ) ) {
+      Mix( ptr );
+      ptr += sizeof( uint64_t );
+      size -= sizeof( uint64_t );
+    }
+
+    while( size > 0 ) {
+      mPending[ mNumPending++ ] = *ptr++;
+      size--;
+    }
+  }
+
+  uint64_t Value() const {
+    uint64_t hash = mHash;
+    for( size_t i = 0; i < mNumPending; i++ ) {
+      hash ^= ( uint8_t ) mPending[ i ];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+private:
+  inline void Mix( const char* ptr ) {
+    uint64_t word;
+    memcpy( &word, ptr, sizeof( word ) );
+    mHash ^= word;
+    mHash *= 1099511628211ULL;
+  }
+
+  uint64_t mHash;
+  char     mPending[ sizeof( uint64_t ) ];
+  size_t   mNumPending;
+};
+
+class Writer {
+public:
+  Writer( const std::string& pathToFile, const uint32_t alphabetBits )
+      : mFile( pathToFile, std::ios::binary ), mAlphabetBits( alphabetBits ),
+        mOffset( 0 ) {
+    Header header;
+    memset( &header, 0, sizeof( header ) );
+    mFile.write( ( const char* ) &header, sizeof( header ) );
+    mOffset = sizeof( header );
+  }
+
+  template < typename T >
+  void Add( const T* data, const size_t count ) {
+    Pad();
+    mSections.push_back( { mOffset, count, sizeof( T ) } );
+    Write( data, count * sizeof( T ) );
+  }
+
+  template < typename Container >
+  void Add( const Container& container ) {
+    Add( container.data(), container.size() );
+  }
+
+  bool Close() {
+    Pad();
+
+    Header header;
+    memcpy( header.magic, Magic, sizeof( Magic ) );
+    header.version            = Version;
+    header.alphabetBits       = mAlphabetBits;
+    header.numSections        = mSections.size();
+    header.sectionTableOffset = mOffset;
+
+    Write( mSections.data(), mSections.size() * sizeof( SectionEntry ) );
+    header.checksum = mChecksum.Value();
+
+    mFile.seekp( 0 );
+    mFile.write( ( const char* ) &header, sizeof( header ) );
+    mFile.close();
+
+    return !mFile.fail();
+  }
+
+private:
+  void Write( const void* data, const size_t size ) {
+    mFile.write( ( const char* ) data, size );
+    mChecksum.Update( data, size );
+    mOffset += size;
+  }
+
+  void Pad() {
+    static const char zeros[ SectionAlignment ] = { 0 };
+
+    size_t rest = mOffset % SectionAlignment;
+    if( rest > 0 ) {
+      Write( zeros, SectionAlignment - rest );
+    }
+  }
+
+  std::ofstream               mFile;
+  uint32_t                    mAlphabetBits;
+  uint64_t                    mOffset;
+  Checksum                    mChecksum;
+  std::vector< SectionEntry > mSections;
+};
+
+class Reader {
+public:
+  Reader( const std::string& pathToFile, const bool verifyChecksum = true )
+      : mFile( std::make_shared< MappedFile >( pathToFile ) ),
+        mHeader( NULL ), mSections( NULL ) {
+    if( !mFile->IsOpen() || mFile->Size() < sizeof( Header ) )
+      return;
+
+    auto header = ( const Header* ) mFile->Data();
+    if( memcmp( header->magic, Magic, sizeof( Magic ) ) != 0 ||
+        header->version != Version )
+      return;
+
+    size_t tableSize = header->numSections * sizeof( SectionEntry );
+    if( header->sectionTableOffset < sizeof( Header ) ||
+        header->sectionTableOffset + tableSize != mFile->Size() )
+      return;
+
+    if( verifyChecksum ) {
+      Checksum checksum;
+      checksum.Update( mFile->Data() + sizeof( Header ),
+                       mFile->Size() - sizeof( Header ) );
+      if( checksum.Value() != header->checksum )
+        return;
+    }
+
+    mHeader = header;
+    mSections =
+      ( const SectionEntry* ) ( mFile->Data() + header->sectionTableOffset );
+  }
+
+  static bool IsIndexFile( const std::string& pathToFile ) {
+    std::ifstream file( pathToFile, std::ios::binary );
+    char          magic[ sizeof( Magic ) ];
+    file.read( magic, sizeof( magic ) );
+    return file && memcmp( magic, Magic, sizeof( Magic ) ) == 0;
+  }
+
+  bool IsValid() const {
+    return mHeader != NULL;
+  }
+
+  uint32_t AlphabetBits() const {
+    return IsValid() ? mHeader->alphabetBits : 0;
+  }
+
+  size_t NumSections() const {
+    return IsValid() ? mHeader->numSections : 0;
+  }
+
+  // Points array to the section in the mapped file (no copy)
+  template < typename T >
+  bool Get( const size_t index, IndexArray< T >* array ) const {
+    if( index >= NumSections() )
+      return false;
+
+    const SectionEntry& section = mSections[ index ];
+    if( section.elementSize != sizeof( T ) ||
+        section.offset % SectionAlignment != 0 ||
+        section.offset + section.count * sizeof( T ) >
+          mHeader->sectionTableOffset )
+      return false;
+
+    *array = IndexArray< T >( ( const T* ) ( mFile->Data() + section.offset ),
+                              section.count, mFile );
+    return true;
+  }
+
+private:
+  std::shared_ptr< MappedFile > mFile;
+  const Header*                 mHeader;
+  const SectionEntry*           mSections;
+};
+
+} // namespace IndexFile
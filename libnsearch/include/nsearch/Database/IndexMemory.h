@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+/*
+ * Memory of the (large) index arrays, which every search thread accesses
+ * at random. Backing them with huge pages saves TLB misses, interleaving
+ * them across NUMA nodes spreads the memory traffic of all threads
+ * instead of having them all hit the node which built the index.
+ * Both are hints, allocations fall back to regular pages where
+ * not supported.
+ */
+struct IndexMemoryPolicy {
+  // Transparent huge pages (madvise)
+  bool hugePages = false;
+
+  // Explicitly reserved huge pages (hugetlbfs), if there are enough
+  bool reservedHugePages = false;
+
+  // Spread pages evenly across all NUMA nodes
+  bool interleave = false;
+};
+
+namespace IndexMemory {
+
+// Arrays smaller than a huge page are allocated as usual
+static const size_t MinPolicySize = size_t( 2 ) << 20;
+
+// Applies to arrays allocated afterwards
+void                     SetPolicy( const IndexMemoryPolicy& policy );
+const IndexMemoryPolicy& Policy();
+
+// At least MinPolicySize bytes, zeroed
+void* Allocate( const size_t numBytes );
+void  Free( void* ptr, const size_t numBytes );
+
+} // namespace IndexMemory
+
+// Allocator for the index arrays' own storage
+template < typename T >
+class IndexAllocator {
+public:
+  using value_type = T;
+
+  IndexAllocator() {}
+
+  template < typename U >
+  IndexAllocator( const IndexAllocator< U >& other ) {}
+
+  T* allocate( const size_t n ) {
+    const size_t numBytes = n * sizeof( T );
+    if( numBytes < IndexMemory::MinPolicySize )
+      return static_cast< T* >( ::operator new( numBytes ) );
+
+    return static_cast< T* >( IndexMemory::Allocate( numBytes ) );
+  }
+
+  void deallocate( T* ptr, const size_t n ) {
+    const size_t numBytes = n * sizeof( T );
+    if( numBytes < IndexMemory::MinPolicySize ) {
+      ::operator delete( ptr );
+      return;
+    }
+
+    IndexMemory::Free( ptr, numBytes );
+  }
+};
+
+template < typename T, typename U >
+bool operator==( const IndexAllocator< T >&, const IndexAllocator< U >& ) {
+  return true;
+}
+
+template < typename T, typename U >
+bool operator!=( const IndexAllocator< T >&, const IndexAllocator< U >& ) {
+  return false;
+}
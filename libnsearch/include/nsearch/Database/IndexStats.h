@@ -0,0 +1,223 @@
+#pragma once
+
+#include "../Database.h"
+#include "GlobalSearch.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * What a database index is made of, to see why searching it is slow
+ * (or why it is large): memory of each array, the distribution of the
+ * posting list lengths, the most frequent kmers and the number of
+ * postings a query has to count.
+ */
+template < typename Alphabet >
+class IndexStats {
+public:
+  // Counting cost is measured on (at most) this many database sequences,
+  // unless measured on queries
+  static const size_t MaxSampledSequences = 1000;
+
+  IndexStats( const Database< Alphabet >& db, const size_t numTopKmers = 10 );
+
+  // Measure the counting cost on these queries instead
+  void MeasureCountingCost( const SequenceList< Alphabet >& queries );
+
+  // Name and size (bytes) of each array
+  std::vector< std::pair< std::string, size_t > > arrays;
+  size_t                                          totalBytes = 0;
+
+  size_t numSequences = 0;
+  size_t numResidues  = 0;
+
+  // Kmers with a posting list
+  size_t numKmers             = 0;
+  size_t numPostings          = 0;
+  size_t maxPostingListLength = 0;
+  size_t numStopKmers         = 0;
+
+  // Number of posting lists with 2^i to 2^(i+1) - 1 postings
+  std::vector< size_t > postingListLengths;
+
+  // Kmers with the most postings (kmer, number of postings), descending
+  std::vector< std::pair< Kmer, size_t > > topKmers;
+
+  // Kmers of the database sequences, and those which can't be indexed
+  // (ambiguous residues or masked)
+  size_t numSequenceKmers  = 0;
+  size_t numAmbiguousKmers = 0;
+
+  // Per query: kmers looked up, postings counted (hit counters
+  // incremented) and hit counters reset afterwards (the ones touched,
+  // or all of them if most were)
+  size_t numCostQueries      = 0;
+  double meanLookupsPerQuery = 0.0;
+  double meanCountingCost    = 0.0;
+  double meanCountersReset   = 0.0;
+
+  double AmbiguousKmerFraction() const {
+    return numSequenceKmers > 0 ? double( numAmbiguousKmers ) / numSequenceKmers
+                                : 0.0;
+  }
+
+private:
+  using SequenceCallback =
+    std::function< void( const Sequence< Alphabet >& seq ) >;
+
+  void MeasureCountingCost(
+    const size_t numQueries,
+    const std::function< void( const SequenceCallback& ) >& forEachQuery );
+
+  const Database< Alphabet >& mDB;
+};
+
+/*
+ * Implementation
+ */
+template < typename A >
+const size_t IndexStats< A >::MaxSampledSequences;
+
+template < typename A >
+IndexStats< A >::IndexStats( const Database< A >& db,
+                             const size_t         numTopKmers )
+    : mDB( db ) {
+  db.ForEachArray( [&]( const std::string& name, const size_t numBytes ) {
+    arrays.push_back( { name, numBytes } );
+    totalBytes += numBytes;
+  } );
+
+  // Posting lists, keeping the numTopKmers longest in a min-heap
+  using Entry = std::pair< size_t, Kmer >;
+  std::priority_queue< Entry, std::vector< Entry >, std::greater< Entry > >
+    longest;
+
+  db.ForEachPostingList( [&]( const Kmer kmer, const size_t numIds ) {
+    numKmers++;
+    numPostings += numIds;
+    maxPostingListLength = std::max( maxPostingListLength, numIds );
+
+    size_t bucket = 0;
+    while( ( numIds >> ( bucket + 1 ) ) > 0 )
+      bucket++;
+    if( postingListLengths.size() <= bucket ) {
+      postingListLengths.resize( bucket + 1 );
+    }
+    postingListLengths[ bucket ]++;
+
+    longest.push( { numIds, kmer } );
+    if( longest.size() > numTopKmers ) {
+      longest.pop();
+    }
+  } );
+
+  while( !longest.empty() ) {
+    topKmers.push_back( { longest.top().second, longest.top().first } );
+    longest.pop();
+  }
+  std::reverse( topKmers.begin(), topKmers.end() );
+
+  numStopKmers = db.NumStopKmers();
+
+  // Kmers of all sequences
+  Sequence< A > seq;
+  MaskedRegions masked;
+  numSequences = db.NumSequences();
+  for( SequenceId seqId = 0; seqId < numSequences; seqId++ ) {
+    db.GetSequenceById( seqId, &seq );
+    db.GetMaskedRegions( seq, &masked );
+    numResidues += seq.Length();
+
+    Kmers< A >( seq, db.Seed(), &masked )
+      .ForEach( [&]( const Kmer kmer, const size_t ) {
+        numSequenceKmers++;
+        if( kmer == AmbiguousKmer )
+          numAmbiguousKmers++;
+      } );
+  }
+
+  // Database sequences (evenly spread) stand in for queries
+  const size_t numSampled = std::min( numSequences, MaxSampledSequences );
+  MeasureCountingCost( numSampled, [&]( const SequenceCallback& block ) {
+    for( size_t i = 0; i < numSampled; i++ ) {
+      db.GetSequenceById( SequenceId( i * numSequences / numSampled ), &seq );
+      block( seq );
+    }
+  } );
+}
+
+template < typename A >
+void IndexStats< A >::MeasureCountingCost( const SequenceList< A >& queries ) {
+  MeasureCountingCost( queries.size(),
+                       [&]( const SequenceCallback& block ) {
+                         for( auto& query : queries ) {
+                           block( query );
+                         }
+                       } );
+}
+
+template < typename A >
+void IndexStats< A >::MeasureCountingCost(
+  const size_t                                            numQueries,
+  const std::function< void( const SequenceCallback& ) >& forEachQuery ) {
+  numCostQueries      = numQueries;
+  meanLookupsPerQuery = 0.0;
+  meanCountingCost    = 0.0;
+  meanCountersReset   = 0.0;
+  if( numQueries == 0 )
+    return;
+
+  // Like the search: every distinct kmer is looked up once
+  std::vector< Kmer >       kmers;
+  SequenceIdBuffer          buffer;
+  std::vector< bool >       isTouched( mDB.NumSequences() );
+  std::vector< SequenceId > touchedIds;
+  size_t                    numLookups = 0, numCounted = 0, numReset = 0;
+  forEachQuery( [&]( const Sequence< A >& query ) {
+    kmers.clear();
+    mDB.ForEachIndexedKmer( query, [&]( const Kmer kmer, const size_t ) {
+      if( kmer != AmbiguousKmer )
+        kmers.push_back( kmer );
+    } );
+    std::sort( kmers.begin(), kmers.end() );
+    kmers.erase( std::unique( kmers.begin(), kmers.end() ), kmers.end() );
+
+    for( auto kmer : kmers ) {
+      if( mDB.Params().canonicalKmers ) {
+        bool isReverse;
+        kmer = CanonicalKmer< A >( kmer, mDB.KmerLength(), &isReverse );
+      }
+
+      const SequenceId* seqIds;
+      size_t            numSeqIds;
+      mDB.GetSequenceIdsIncludingKmer( kmer, &seqIds, &numSeqIds, &buffer );
+      numCounted += numSeqIds;
+
+      for( size_t i = 0; i < numSeqIds; i++ ) {
+        const SequenceId seqId =
+          mDB.Params().canonicalKmers ? seqIds[ i ] >> 1 : seqIds[ i ];
+        if( !isTouched[ seqId ] ) {
+          isTouched[ seqId ] = true;
+          touchedIds.push_back( seqId );
+        }
+      }
+    }
+    numLookups += kmers.size();
+
+    numReset += ResetsAllCounters( touchedIds.size(), isTouched.size() )
+                  ? isTouched.size()
+                  : touchedIds.size();
+    for( auto seqId : touchedIds ) {
+      isTouched[ seqId ] = false;
+    }
+    touchedIds.clear();
+  } );
+
+  meanLookupsPerQuery = double( numLookups ) / numQueries;
+  meanCountingCost    = double( numCounted ) / numQueries;
+  meanCountersReset   = double( numReset ) / numQueries;
+}
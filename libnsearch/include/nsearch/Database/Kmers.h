@@ -2,47 +2,190 @@
 
 #include "../Sequence.h"
 #include "../Utils.h"
+#include "../Alphabet/DNA.h"
+#include "SeedMask.h"
 
+#include <array>
+#include <cassert>
 #include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
-using Kmer = uint32_t;
+using Kmer = uint64_t;
 const Kmer AmbiguousKmer = ( Kmer )-1;
 
+// Sorted, non-overlapping [begin, end) ranges of a sequence
+// which are treated like ambiguous residues
+using MaskedRegions = std::vector< std::pair< size_t, size_t > >;
+
+// Longest kmer that fits, leaving AmbiguousKmer unused
+template < typename Alphabet >
+constexpr size_t MaxKmerLength() {
+  return ( sizeof( Kmer ) * 8 - 1 ) / BitMapPolicy< Alphabet >::NumBits;
+}
+
+// Reverse complement of a packed kmer (only where the alphabet has one)
+template < typename Alphabet >
+struct KmerComplementPolicy {
+  static const bool HasComplement = false;
+
+  inline static Kmer ReverseComplement( const Kmer kmer, const size_t ) {
+    return kmer;
+  }
+};
+
+template <>
+struct KmerComplementPolicy< DNA > {
+  static const bool HasComplement = true;
+
+  // A (00) <-> T (10), C (01) <-> G (11): flip the upper bit,
+  // then reverse the order of the 2-bit nucleotides
+  inline static Kmer ReverseComplement( const Kmer kmer, const size_t length ) {
+    Kmer x = kmer ^ 0xAAAAAAAAAAAAAAAAULL;
+    x = ( ( x >> 2 ) & 0x3333333333333333ULL ) |
+        ( ( x & 0x3333333333333333ULL ) << 2 );
+    x = ( ( x >> 4 ) & 0x0F0F0F0F0F0F0F0FULL ) |
+        ( ( x & 0x0F0F0F0F0F0F0F0FULL ) << 4 );
+    x = ( ( x >> 8 ) & 0x00FF00FF00FF00FFULL ) |
+        ( ( x & 0x00FF00FF00FF00FFULL ) << 8 );
+    x = ( ( x >> 16 ) & 0x0000FFFF0000FFFFULL ) |
+        ( ( x & 0x0000FFFF0000FFFFULL ) << 16 );
+    x = ( x >> 32 ) | ( x << 32 );
+    return x >> ( 64 - 2 * length );
+  }
+};
+
+// Smaller of kmer and its reverse complement. isReverse is set
+// if that is the reverse complement. For spaced seeds this only holds
+// if the seed is symmetric (see SeedMask::IsSymmetric).
+template < typename Alphabet >
+inline Kmer CanonicalKmer( const Kmer kmer, const size_t length,
+                           bool* isReverse ) {
+  Kmer reverse =
+    KmerComplementPolicy< Alphabet >::ReverseComplement( kmer, length );
+  *isReverse = reverse < kmer;
+  return *isReverse ? reverse : kmer;
+}
+
+// Scrambles a kmer (fmix64 of MurmurHash3), so similar kmers
+// (e.g. AAAA... and AAAC...) end up far apart
+inline uint64_t HashKmer( Kmer kmer ) {
+  kmer ^= kmer >> 33;
+  kmer *= 0xff51afd7ed558ccdULL;
+  kmer ^= kmer >> 33;
+  kmer *= 0xc4ceb9fe1a85ec53ULL;
+  kmer ^= kmer >> 33;
+  return kmer;
+}
+
+// Residues of a packed kmer (only the positions of the seed), e.g. for
+// display. A code shared by several residues is shown as the first one.
+template < typename Alphabet >
+std::string KmerToString( const Kmer kmer, const size_t length ) {
+  const size_t NumBits = BitMapPolicy< Alphabet >::NumBits;
+  const Kmer   Mask    = ( Kmer( 1 ) << NumBits ) - 1;
+
+  std::string str( length, '?' );
+  for( size_t pos = 0; pos < length; pos++ ) {
+    const int8_t code = ( kmer >> ( pos * NumBits ) ) & Mask;
+    for( char ch = 'A'; ch <= 'Z'; ch++ ) {
+      if( BitMapPolicy< Alphabet >::BitMap( ch ) == code ) {
+        str[ pos ] = ch;
+        break;
+      }
+    }
+  }
+  return str;
+}
+
 template< typename Alphabet >
 class Kmers {
 public:
   using Callback = const std::function< void( const Kmer, const size_t ) >;
 
-  Kmers( const Sequence< Alphabet >& ref, const size_t length ) : mRef( ref ) {
-    mLength = std::min( { length, mRef.Length(), sizeof( Kmer ) * 8 / BitMapPolicy< Alphabet >::NumBits } );
+  Kmers( const Sequence< Alphabet >& ref, const size_t length )
+      : Kmers( ref, SeedMask( length ) ) {}
+
+  // Spaced seed: only positions in the mask make up the kmer.
+  // Kmers overlapping a masked region are ambiguous.
+  Kmers( const Sequence< Alphabet >& ref, const SeedMask& seed,
+         const MaskedRegions* masked = nullptr )
+      : mNumRuns( 0 ), mMasked( masked ), mRef( ref ) {
+    mLength =
+      std::min( { seed.Span(), mRef.Length(), MaxKmerLength< Alphabet >() } );
+    mCareBits = SeedMask( seed.CareBits(), mLength ).CareBits();
+
+    // Compile mask into shift/mask pairs, one for each run of 1s,
+    // moving the run right next to the previous one
+    size_t numPacked = 0;
+    for( size_t pos = 0; pos < mLength; ) {
+      if( !( ( mCareBits >> pos ) & 1 ) ) {
+        pos++;
+        continue;
+      }
+
+      size_t end = pos;
+      while( end < mLength && ( ( mCareBits >> end ) & 1 ) )
+        end++;
+
+      Kmer runBits = ( Kmer( 1 ) << ( ( end - pos ) * NumBits ) ) - 1;
+      assert( mNumRuns < MaxRuns );
+      mRuns[ mNumRuns++ ] = { ( pos - numPacked ) * NumBits,
+                              runBits << ( numPacked * NumBits ) };
+      numPacked += end - pos;
+      pos = end;
+    }
   }
 
   void ForEach( const Callback& block ) const {
     const char* ptr = mRef.sequence.data();
 
-    auto bitIndex = []( const size_t pos ) {
-      return ( pos * BitMapPolicy< Alphabet >::NumBits ) % ( sizeof( Kmer ) * 8 );
-    };
-
     auto bitMapNucleotide = []( const char base ) {
       return BitMapPolicy< Alphabet >::BitMap( base );
     };
 
+    auto pack = [&]( const Kmer window ) {
+      Kmer kmer = 0;
+      for( size_t index = 0; index < mNumRuns; index++ ) {
+        kmer |= ( window >> mRuns[ index ].shift ) & mRuns[ index ].mask;
+      }
+      return kmer;
+    };
+
+    // Positions are checked in ascending order
+    MaskedRegions::const_iterator region, regionsEnd;
+    if( mMasked ) {
+      region     = mMasked->begin();
+      regionsEnd = mMasked->end();
+    }
+    auto isMasked = [&]( const size_t pos ) {
+      if( !mMasked )
+        return false;
+
+      while( region != regionsEnd && region->second <= pos )
+        ++region;
+      return region != regionsEnd && region->first <= pos;
+    };
+
+    // Window holds all positions, ambiguous has bit i set
+    // if position i of the window is ambiguous
+    Kmer     window    = 0;
+    uint64_t ambiguous = 0;
+
     // First kmer
-    size_t lastAmbigIndex = ( size_t ) -1;
-    Kmer   kmer           = 0;
     for( size_t k = 0; k < mLength; k++ ) {
       int8_t val = bitMapNucleotide( *ptr );
-      if( val < 0 ) {
-        lastAmbigIndex = k;
+      if( val < 0 || isMasked( k ) ) {
+        ambiguous |= uint64_t( 1 ) << k;
       } else {
-        kmer |= ( val << bitIndex( k ) );
+        window |= ( Kmer( val ) << ( k * NumBits ) );
       }
       ptr++;
     }
 
-    if( lastAmbigIndex == ( size_t ) -1 ) {
-      block( kmer, 0 );
+    if( ( ambiguous & mCareBits ) == 0 ) {
+      block( pack( window ), 0 );
     } else {
       block( AmbiguousKmer, 0 );
     }
@@ -50,16 +193,18 @@ public:
     // For each consecutive kmer, shift window by one
     size_t maxFrame = mRef.Length() - mLength;
     for( size_t frame = 1; frame <= maxFrame; frame++, ptr++ ) {
-      kmer >>= BitMapPolicy< Alphabet >::NumBits;
+      window >>= NumBits;
+      ambiguous >>= 1;
+
       int8_t val = bitMapNucleotide( *ptr );
-      if( val < 0 ) {
-        lastAmbigIndex = frame + mLength - 1;
+      if( val < 0 || isMasked( frame + mLength - 1 ) ) {
+        ambiguous |= uint64_t( 1 ) << ( mLength - 1 );
       } else {
-        kmer |= ( val << bitIndex( mLength - 1 ) );
+        window |= ( Kmer( val ) << ( ( mLength - 1 ) * NumBits ) );
       }
 
-      if( lastAmbigIndex == ( size_t ) -1 || frame > lastAmbigIndex ) {
-        block( kmer, frame );
+      if( ( ambiguous & mCareBits ) == 0 ) {
+        block( pack( window ), frame );
       } else {
         block( AmbiguousKmer, frame );
       }
@@ -71,6 +216,21 @@ public:
   }
 
 private:
+  static const size_t NumBits = BitMapPolicy< Alphabet >::NumBits;
+
+  struct Run {
+    size_t shift;
+    Kmer   mask;
+  };
+
+  // Runs of 1s are separated by 0s, so a 64-bit mask has at most 32
+  // (a fixed array, as kmers are enumerated for every query)
+  static const size_t MaxRuns = 32;
+
   size_t                      mLength;
+  uint64_t                    mCareBits;
+  std::array< Run, MaxRuns >  mRuns;
+  size_t                      mNumRuns;
+  const MaskedRegions*        mMasked;
   const Sequence< Alphabet >& mRef;
 };
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Kmers.h"
+
+#include <limits>
+#include <vector>
+
+// Kmers of a sequence and their hashes, reused by Minimizers::ForEach
+struct MinimizerBuffer {
+  std::vector< Kmer >     kmers;
+  std::vector< uint64_t > hashes;
+};
+
+/*
+ * Window minimizers: of every window of consecutive kmers, only the one
+ * with the smallest hash is kept. Two sequences sharing a stretch of
+ * window + length - 1 residues share at least one minimizer.
+ * A window of 0 or 1 keeps every kmer.
+ */
+template < typename Alphabet >
+class Minimizers {
+public:
+  using Callback = typename Kmers< Alphabet >::Callback;
+
+  // Canonical: order kmers by their canonical form, so a sequence and its
+  // reverse complement select the same kmers
+  Minimizers( const Sequence< Alphabet >& ref, const SeedMask& seed,
+              const size_t window, const bool canonical = false,
+              const MaskedRegions* masked = nullptr )
+      : mKmers( ref, seed, masked ), mWeight( seed.Weight() ),
+        mWindow( window ), mCanonical( canonical ) {}
+
+  void ForEach( const Callback& block ) const {
+    MinimizerBuffer buffer;
+    ForEach( block, &buffer );
+  }
+
+  // Same, reusing the memory of buffer (e.g. for every query)
+  void ForEach( const Callback& block, MinimizerBuffer* buffer ) const {
+    if( mWindow <= 1 ) {
+      mKmers.ForEach( block );
+      return;
+    }
+
+    std::vector< Kmer >&     kmers  = buffer->kmers;
+    std::vector< uint64_t >& hashes = buffer->hashes;
+    kmers.clear();
+    hashes.clear();
+    // Captures no more than two pointers, which std::function
+    // stores without allocating
+    mKmers.ForEach( [this, buffer]( const Kmer kmer, const size_t ) {
+      buffer->kmers.push_back( kmer );
+      buffer->hashes.push_back( Hash( kmer ) );
+    } );
+
+    const size_t none   = std::numeric_limits< size_t >::max();
+    const size_t window = std::min( mWindow, kmers.size() );
+
+    // Smallest hash of the current window (leftmost on ties),
+    // only rescanned once it drops out of the window
+    size_t minPos = none, lastPos = none;
+    for( size_t end = window - 1; end < kmers.size(); end++ ) {
+      const size_t start = end + 1 - window;
+
+      if( minPos == none || minPos < start ) {
+        minPos = none;
+        for( size_t pos = start; pos <= end; pos++ ) {
+          if( kmers[ pos ] != AmbiguousKmer &&
+              ( minPos == none || hashes[ pos ] < hashes[ minPos ] ) )
+            minPos = pos;
+        }
+      } else if( kmers[ end ] != AmbiguousKmer &&
+                 hashes[ end ] < hashes[ minPos ] ) {
+        minPos = end;
+      }
+
+      if( minPos != none && minPos != lastPos ) {
+        block( kmers[ minPos ], minPos );
+        lastPos = minPos;
+      }
+    }
+  }
+
+private:
+  // Scrambled, so low-complexity kmers (AAAA...) are not always picked
+  uint64_t Hash( Kmer kmer ) const {
+    if( mCanonical && kmer != AmbiguousKmer ) {
+      bool isReverse;
+      kmer = CanonicalKmer< Alphabet >( kmer, mWeight, &isReverse );
+    }
+
+    return HashKmer( kmer );
+  }
+
+  Kmers< Alphabet > mKmers;
+  size_t            mWeight;
+  size_t            mWindow;
+  bool              mCanonical;
+};
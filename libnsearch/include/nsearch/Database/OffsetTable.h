@@ -0,0 +1,101 @@
+#pragma once
+
+#include "IndexArray.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+/*
+ * Start offsets of consecutive entries within one big array (CSR layout).
+ * Entry i spans [Begin(i), End(i)), so no separate count is needed.
+ * Offsets are stored with 32 bits unless the total doesn't fit.
+ */
+class OffsetTable {
+public:
+  OffsetTable() {}
+
+  // Allocate numEntries + 1 offsets, wide enough for total
+  void Reset( const size_t numEntries, const size_t total ) {
+    if( total > std::numeric_limits< uint32_t >::max() ) {
+      mNarrow = IndexArray< uint32_t >();
+      mWide   = IndexArray< uint64_t >( numEntries + 1 );
+    } else {
+      mNarrow = IndexArray< uint32_t >( numEntries + 1 );
+      mWide   = IndexArray< uint64_t >();
+    }
+  }
+
+  inline void Set( const size_t index, const size_t offset ) {
+    if( IsWide() ) {
+      mWide[ index ] = offset;
+    } else {
+      mNarrow[ index ] = offset;
+    }
+  }
+
+  inline size_t Begin( const size_t index ) const {
+    return IsWide() ? mWide[ index ] : mNarrow[ index ];
+  }
+
+  inline size_t End( const size_t index ) const {
+    return Begin( index + 1 );
+  }
+
+  inline size_t Count( const size_t index ) const {
+    return End( index ) - Begin( index );
+  }
+
+  // End of the last entry
+  size_t Total() const {
+    size_t numEntries = NumEntries();
+    return numEntries > 0 ? End( numEntries - 1 ) : 0;
+  }
+
+  size_t NumEntries() const {
+    size_t size = IsWide() ? mWide.size() : mNarrow.size();
+    return size > 0 ? size - 1 : 0;
+  }
+
+  // Offsets never decrease and end within an array of size elements
+  // (e.g. after loading from a file)
+  bool IsValid( const size_t size ) const {
+    if( !mNarrow.empty() && !mWide.empty() )
+      return false;
+
+    bool ascending =
+      IsWide() ? std::is_sorted( mWide.data(), mWide.data() + mWide.size() )
+               : std::is_sorted( mNarrow.data(),
+                                 mNarrow.data() + mNarrow.size() );
+    return ascending && Total() <= size;
+  }
+
+  size_t NumBytes() const {
+    return mNarrow.NumBytes() + mWide.NumBytes();
+  }
+
+  inline bool IsWide() const {
+    return !mWide.empty();
+  }
+
+  // Raw arrays, one of them is empty
+  IndexArray< uint32_t >& Narrow() {
+    return mNarrow;
+  }
+
+  const IndexArray< uint32_t >& Narrow() const {
+    return mNarrow;
+  }
+
+  IndexArray< uint64_t >& Wide() {
+    return mWide;
+  }
+
+  const IndexArray< uint64_t >& Wide() const {
+    return mWide;
+  }
+
+private:
+  IndexArray< uint32_t > mNarrow;
+  IndexArray< uint64_t > mWide;
+};
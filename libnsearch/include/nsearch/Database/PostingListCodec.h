@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Compression of sorted posting lists (sequence ids)
+ *
+ * The number of ids is stored upfront (varint). Ids are delta encoded
+ * (gap - 1, since ids are unique and ascending) and bit-packed in blocks
+ * of BlockSize values. Each block starts with one byte
+ * holding the bit width of its values. Decoding a block has no dependencies
+ * between values apart from the final prefix sum.
+ *
+ * Decoding reads up to Padding bytes past the end of the encoded data.
+ */
+class PostingListCodec {
+public:
+  static const size_t BlockSize = 128;
+  static const size_t Padding   = sizeof( uint64_t );
+
+  static size_t EncodedSize( const uint32_t* ids, const size_t count ) {
+    size_t   size = VarintSize( count );
+    uint32_t prev = -1;
+    for( size_t start = 0; start < count; start += BlockSize ) {
+      size_t  num   = std::min( size_t( BlockSize ), count - start );
+      uint8_t width = BlockWidth( ids + start, num, prev );
+      size += 1 + ( num * width + 7 ) / 8;
+      prev = ids[ start + num - 1 ];
+    }
+    return size;
+  }
+
+  // out needs to be zero-initialized, EncodedSize() + Padding bytes
+  static size_t Encode( const uint32_t* ids, const size_t count,
+                        uint8_t* out ) {
+    uint8_t* ptr  = out;
+    uint32_t prev = -1;
+
+    size_t value = count;
+    while( value >= 0x80 ) {
+      *ptr++ = ( value & 0x7F ) | 0x80;
+      value >>= 7;
+    }
+    *ptr++ = value;
+
+    for( size_t start = 0; start < count; start += BlockSize ) {
+      size_t  num   = std::min( size_t( BlockSize ), count - start );
+      uint8_t width = BlockWidth( ids + start, num, prev );
+      *ptr++        = width;
+
+      for( size_t i = 0; i < num; i++ ) {
+        uint32_t delta  = ids[ start + i ] - prev - 1;
+        size_t   bitPos = i * width;
+
+        uint64_t word;
+        memcpy( &word, ptr + bitPos / 8, sizeof( word ) );
+        word |= uint64_t( delta ) << ( bitPos % 8 );
+        memcpy( ptr + bitPos / 8, &word, sizeof( word ) );
+
+        prev = ids[ start + i ];
+      }
+
+      ptr += ( num * width + 7 ) / 8;
+    }
+    return ptr - out;
+  }
+
+  static size_t NumIds( const uint8_t* in ) {
+    return ReadVarint( &in );
+  }
+
+  // out needs room for NumIds() values, returns number of ids
+  static size_t Decode( const uint8_t* in, uint32_t* out ) {
+    size_t   count = ReadVarint( &in );
+    uint32_t prev  = -1;
+    for( size_t start = 0; start < count; start += BlockSize ) {
+      size_t   num   = std::min( size_t( BlockSize ), count - start );
+      uint8_t  width = *in++;
+      uint64_t mask  = ( uint64_t( 1 ) << width ) - 1;
+
+      uint32_t* block = out + start;
+      for( size_t i = 0; i < num; i++ ) {
+        size_t   bitPos = i * width;
+        uint64_t word;
+        memcpy( &word, in + bitPos / 8, sizeof( word ) );
+        block[ i ] = ( word >> ( bitPos % 8 ) ) & mask;
+      }
+
+      for( size_t i = 0; i < num; i++ ) {
+        prev += block[ i ] + 1;
+        block[ i ] = prev;
+      }
+
+      in += ( num * width + 7 ) / 8;
+    }
+
+    return count;
+  }
+
+  // Whether the list at in fits in size bytes and decodes to ascending ids
+  // below limit (e.g. after loading from a file). Like Decode, this reads
+  // up to Padding bytes past the end.
+  static bool IsValid( const uint8_t* in, const size_t size,
+                       const size_t limit ) {
+    const uint8_t* end = in + size;
+
+    size_t count = 0;
+    for( size_t shift = 0;; shift += 7 ) {
+      if( in == end || shift >= 64 )
+        return false;
+
+      uint8_t byte = *in++;
+      count |= size_t( byte & 0x7F ) << shift;
+      if( byte < 0x80 )
+        break;
+    }
+    if( count > limit )
+      return false;
+
+    // Smallest id the next gap can lead to (ids ascend)
+    uint64_t next = 0;
+    for( size_t start = 0; start < count; start += BlockSize ) {
+      size_t num = std::min( size_t( BlockSize ), count - start );
+      if( in == end )
+        return false;
+
+      uint8_t width = *in++;
+      size_t  bytes = ( num * width + 7 ) / 8;
+      if( width > 32 || bytes > size_t( end - in ) )
+        return false;
+
+      uint64_t mask = ( uint64_t( 1 ) << width ) - 1;
+      for( size_t i = 0; i < num; i++ ) {
+        size_t   bitPos = i * width;
+        uint64_t word;
+        memcpy( &word, in + bitPos / 8, sizeof( word ) );
+        next += ( ( word >> ( bitPos % 8 ) ) & mask ) + 1;
+        if( next > limit )
+          return false;
+      }
+
+      in += bytes;
+    }
+
+    return true;
+  }
+
+private:
+  static size_t VarintSize( size_t value ) {
+    size_t size = 1;
+    while( value >= 0x80 ) {
+      value >>= 7;
+      size++;
+    }
+    return size;
+  }
+
+  static size_t ReadVarint( const uint8_t** in ) {
+    size_t value = 0;
+    for( size_t shift = 0;; shift += 7 ) {
+      uint8_t byte = *( *in )++;
+      value |= size_t( byte & 0x7F ) << shift;
+      if( byte < 0x80 )
+        break;
+    }
+    return value;
+  }
+
+  static uint8_t BlockWidth( const uint32_t* ids, const size_t num,
+                             uint32_t prev ) {
+    uint32_t maxDelta = 0;
+    for( size_t i = 0; i < num; i++ ) {
+      maxDelta = std::max( maxDelta, ids[ i ] - prev - 1 );
+      prev     = ids[ i ];
+    }
+
+    uint8_t width = 0;
+    while( width < 32 && ( maxDelta >> width ) > 0 )
+      width++;
+    return width;
+  }
+};
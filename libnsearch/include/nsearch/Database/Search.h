@@ -6,6 +6,7 @@
 
 #include "nsearch/Alphabet/DNA.h"
 
+#include <algorithm>
 #include <deque>
 #include <vector>
 
@@ -13,6 +14,12 @@ struct BaseSearchParams {
   int   maxAccepts  = 1;
   int   maxRejects  = 16;
   float minIdentity = 0.75f;
+
+  // Skip targets whose length ratio (shorter / longer, compared to the
+  // query) is below this, 0 to consider all. Set to minIdentity, targets
+  // skipped could only reach it through terminal gaps, which don't count
+  // towards identity.
+  float minLengthRatio = 0.0f;
 };
 
 template < typename Alphabet >
@@ -23,10 +30,13 @@ struct SearchParams< DNA > : public BaseSearchParams {
   DNA::Strand strand = DNA::Strand::Plus;
 };
 
+// duplicate: target is a collapsed copy of the hit before it (see
+// DatabaseParams::collapseDuplicates), sharing its alignment
 template < typename Alphabet >
 struct Hit {
   Sequence< Alphabet > target;
   Cigar                alignment;
+  bool                 duplicate;
 };
 
 template <>
@@ -34,17 +44,44 @@ struct Hit< DNA > {
   Sequence< DNA > target;
   Cigar           alignment;
   DNA::Strand     strand;
+  bool            duplicate;
 };
 
 template < typename Alphabet >
 using HitList = std::deque< Hit< Alphabet > >;
 
+// A hit by the target's position in the sequences the database was built
+// from (see Database::OriginalSequenceId) instead of a copy of it, to keep
+// the hits of many queries. Identical targets have the same targetHash.
+template < typename Alphabet >
+struct HitById {
+  SequenceId targetId;
+  size_t     targetHash;
+  Cigar      alignment;
+  bool       duplicate;
+};
+
+template <>
+struct HitById< DNA > {
+  SequenceId  targetId;
+  size_t      targetHash;
+  Cigar       alignment;
+  DNA::Strand strand;
+  bool        duplicate;
+};
+
+template < typename Alphabet >
+using HitByIdList = std::deque< HitById< Alphabet > >;
+
 template < typename Alphabet >
 using QueryHitsPair = std::pair< Sequence< Alphabet >, HitList< Alphabet > >;
 
+// targetId: see HitById
 template < typename Alphabet >
 using SearchForHitsCallback =
-  std::function< void( const Sequence< Alphabet >&, const Cigar& ) >;
+  std::function< void( const Sequence< Alphabet >& target,
+                       const SequenceId targetId, const Cigar& alignment,
+                       bool duplicate ) >;
 
 template < typename Alphabet >
 class Search {
@@ -56,10 +93,25 @@ public:
   inline HitList< Alphabet > Query( const Sequence< Alphabet >& query ) {
     HitList< Alphabet > hits;
 
-    SearchForHits(
-      query, [&]( const Sequence< Alphabet >& target, const Cigar& alignment ) {
-        hits.push_back( { target, alignment } );
-      } );
+    SearchForHits( query, [&]( const Sequence< Alphabet >& target,
+                               const SequenceId, const Cigar& alignment,
+                               bool duplicate ) {
+      hits.push_back( { target, alignment, duplicate } );
+    } );
+
+    return hits;
+  }
+
+  inline HitByIdList< Alphabet >
+  QueryById( const Sequence< Alphabet >& query ) {
+    HitByIdList< Alphabet > hits;
+
+    SearchForHits( query, [&]( const Sequence< Alphabet >& target,
+                               const SequenceId targetId, const Cigar& alignment,
+                               bool duplicate ) {
+      hits.push_back(
+        { targetId, mHash( target.sequence ), alignment, duplicate } );
+    } );
 
     return hits;
   }
@@ -69,33 +121,203 @@ protected:
   SearchForHits( const Sequence< Alphabet >&              query,
                  const SearchForHitsCallback< Alphabet >& callback ) = 0;
 
+  // Hits on the strands asked for (see SearchParams< DNA >)
+  void SearchForHitsOnStrands(
+    const Sequence< Alphabet >&              query,
+    const SearchForHitsCallback< Alphabet >& plusCallback,
+    const SearchForHitsCallback< Alphabet >& minusCallback );
+
+  // Hits of query (plus strand) and of its reverse complement (minus strand)
+  virtual void SearchForHitsOnBothStrands(
+    const Sequence< Alphabet >&              query,
+    const SearchForHitsCallback< Alphabet >& plusCallback,
+    const SearchForHitsCallback< Alphabet >& minusCallback ) {
+    SearchForHits( query, plusCallback );
+    SearchForHits( ReverseComplement( query ), minusCallback );
+  }
+
+  // Reverse complement of query, in a buffer reused for every query
+  const Sequence< Alphabet >&
+  ReverseComplement( const Sequence< Alphabet >& query ) {
+    mReverseComplement = query;
+    std::reverse( mReverseComplement.sequence.begin(),
+                  mReverseComplement.sequence.end() );
+    std::reverse( mReverseComplement.quality.begin(),
+                  mReverseComplement.quality.end() );
+    for( char& ch : mReverseComplement.sequence ) {
+      ch = ComplementPolicy< Alphabet >::Complement( ch );
+    }
+    return mReverseComplement;
+  }
+
   const Database< Alphabet >&     mDB;
   const SearchParams< Alphabet >& mParams;
+  std::hash< std::string >        mHash;
+  Sequence< Alphabet >            mReverseComplement;
 };
 
 /*
  * For DNA, allow strand specification
  */
-template <>
-inline HitList< DNA > Search< DNA >::Query( const Sequence< DNA >& query ) {
-  HitList< DNA > hits;
+template < typename Alphabet >
+void Search< Alphabet >::SearchForHitsOnStrands(
+  const Sequence< Alphabet >&              query,
+  const SearchForHitsCallback< Alphabet >& plusCallback,
+  const SearchForHitsCallback< Alphabet >& ) {
+  SearchForHits( query, plusCallback );
+}
 
+template <>
+inline void Search< DNA >::SearchForHitsOnStrands(
+  const Sequence< DNA >& query, const SearchForHitsCallback< DNA >& plusCallback,
+  const SearchForHitsCallback< DNA >& minusCallback ) {
   auto strand = mParams.strand;
 
-  if( strand == DNA::Strand::Plus || strand == DNA::Strand::Both ) {
-    SearchForHits(
-      query, [&]( const Sequence< DNA >& target, const Cigar& alignment ) {
-        hits.push_back( { target, alignment, DNA::Strand::Plus } );
-      } );
+  if( strand == DNA::Strand::Both ) {
+    SearchForHitsOnBothStrands( query, plusCallback, minusCallback );
+    return;
   }
 
-  if( strand == DNA::Strand::Minus || strand == DNA::Strand::Both ) {
-    SearchForHits(
-      query.Reverse().Complement(),
-      [&]( const Sequence< DNA >& target, const Cigar& alignment ) {
-        hits.push_back( { target, alignment, DNA::Strand::Minus } );
-      } );
+  if( strand == DNA::Strand::Plus ) {
+    SearchForHits( query, plusCallback );
   }
 
+  if( strand == DNA::Strand::Minus ) {
+    SearchForHits( ReverseComplement( query ), minusCallback );
+  }
+}
+
+template <>
+inline HitList< DNA > Search< DNA >::Query( const Sequence< DNA >& query ) {
+  HitList< DNA > hits;
+
+  auto plusCallback = [&]( const Sequence< DNA >& target, const SequenceId,
+                           const Cigar& alignment, bool duplicate ) {
+    hits.push_back( { target, alignment, DNA::Strand::Plus, duplicate } );
+  };
+  auto minusCallback = [&]( const Sequence< DNA >& target, const SequenceId,
+                            const Cigar& alignment, bool duplicate ) {
+    hits.push_back( { target, alignment, DNA::Strand::Minus, duplicate } );
+  };
+
+  SearchForHitsOnStrands( query, plusCallback, minusCallback );
+  return hits;
+}
+
+template <>
+inline HitByIdList< DNA >
+Search< DNA >::QueryById( const Sequence< DNA >& query ) {
+  HitByIdList< DNA > hits;
+
+  auto plusCallback = [&]( const Sequence< DNA >& target,
+                           const SequenceId targetId, const Cigar& alignment,
+                           bool duplicate ) {
+    hits.push_back( { targetId, mHash( target.sequence ), alignment,
+                      DNA::Strand::Plus, duplicate } );
+  };
+  auto minusCallback = [&]( const Sequence< DNA >& target,
+                            const SequenceId targetId, const Cigar& alignment,
+                            bool duplicate ) {
+    hits.push_back( { targetId, mHash( target.sequence ), alignment,
+                      DNA::Strand::Minus, duplicate } );
+  };
+
+  SearchForHitsOnStrands( query, plusCallback, minusCallback );
   return hits;
 }
+
+template < typename Alphabet >
+inline int HitStrand( const Hit< Alphabet >& ) {
+  return 0;
+}
+
+template <>
+inline int HitStrand( const Hit< DNA >& hit ) {
+  return int( hit.strand );
+}
+
+template < typename Alphabet >
+inline int HitStrand( const HitById< Alphabet >& ) {
+  return 0;
+}
+
+template <>
+inline int HitStrand( const HitById< DNA >& hit ) {
+  return int( hit.strand );
+}
+
+template < typename Alphabet >
+inline bool HaveSameTarget( const Hit< Alphabet >& left,
+                            const Hit< Alphabet >& right ) {
+  return left.target.sequence == right.target.sequence;
+}
+
+template < typename Alphabet >
+inline bool HaveSameTarget( const HitById< Alphabet >& left,
+                            const HitById< Alphabet >& right ) {
+  return left.targetHash == right.targetHash;
+}
+
+/*
+ * Merges the hits of a query against one part of a database into the ones
+ * against the other parts: the best hits (by identity), at most maxAccepts
+ * per strand. Duplicates stay with the hit they belong to and don't count
+ * as accepts, like in the search itself. With collapseDuplicates, a hit
+ * identical to an accepted one of another part is its duplicate too, as
+ * the whole database would have collapsed them. Hits is a HitList or a
+ * HitByIdList (whose targets are compared by hash).
+ */
+template < typename Hits >
+void MergeHits( const Hits& hits, const int maxAccepts,
+                const bool collapseDuplicates, Hits* merged ) {
+  using HitType = typename Hits::value_type;
+
+  if( merged->empty() ) {
+    *merged = hits;
+    return;
+  }
+  if( hits.empty() )
+    return;
+
+  // Stable, so duplicates still follow their hit
+  merged->insert( merged->end(), hits.begin(), hits.end() );
+  std::stable_sort(
+    merged->begin(), merged->end(),
+    []( const HitType& left, const HitType& right ) {
+      if( HitStrand( left ) != HitStrand( right ) )
+        return HitStrand( left ) < HitStrand( right );
+      return left.alignment.Identity() > right.alignment.Identity();
+    } );
+
+  Hits   best;
+  size_t strandBegin = 0;
+  int    numAccepts  = 0;
+  bool   accepted    = false;
+  for( auto& hit : *merged ) {
+    if( !best.empty() && HitStrand( best.back() ) != HitStrand( hit ) ) {
+      strandBegin = best.size();
+      numAccepts  = 0;
+    }
+
+    // A duplicate is accepted along with its hit
+    bool duplicate = hit.duplicate;
+    if( !duplicate ) {
+      duplicate = collapseDuplicates &&
+                  std::any_of( best.begin() + strandBegin, best.end(),
+                               [&]( const HitType& other ) {
+                                 return other.alignment == hit.alignment &&
+                                        HaveSameTarget( other, hit );
+                               } );
+      accepted = duplicate || numAccepts < maxAccepts;
+      if( accepted && !duplicate ) {
+        numAccepts++;
+      }
+    }
+
+    if( accepted ) {
+      best.push_back( hit );
+      best.back().duplicate = duplicate;
+    }
+  }
+  *merged = std::move( best );
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Which positions of a word are part of the kmer.
+ * "11011011" (spaced seed) ignores the 3rd and 6th position,
+ * a contiguous word of length k is "1" * k.
+ */
+class SeedMask {
+public:
+  static const size_t MaxSpan = 64;
+
+  // Contiguous word
+  SeedMask( const size_t length = 0 )
+      : mCareBits( LowBits( length ) ), mSpan( length ) {}
+
+  // Bit i set: position i is part of the kmer
+  SeedMask( const uint64_t careBits, const size_t span )
+      : mCareBits( careBits & LowBits( span ) ), mSpan( span ) {}
+
+  SeedMask( const std::string& pattern ) : mCareBits( 0 ), mSpan( 0 ) {
+    if( !IsValid( pattern ) )
+      return;
+
+    for( size_t pos = 0; pos < pattern.size(); pos++ ) {
+      if( pattern[ pos ] == '1' )
+        mCareBits |= uint64_t( 1 ) << pos;
+    }
+    mSpan = pattern.size();
+  }
+
+  // 0s and 1s only, starting and ending with 1
+  static bool IsValid( const std::string& pattern ) {
+    if( pattern.empty() || pattern.size() > MaxSpan ||
+        pattern.front() != '1' || pattern.back() != '1' )
+      return false;
+
+    return pattern.find_first_not_of( "01" ) == std::string::npos;
+  }
+
+  size_t Span() const {
+    return mSpan;
+  }
+
+  size_t Weight() const {
+    size_t weight = 0;
+    for( uint64_t bits = mCareBits; bits; bits &= bits - 1 )
+      weight++;
+    return weight;
+  }
+
+  uint64_t CareBits() const {
+    return mCareBits;
+  }
+
+  bool IsContiguous() const {
+    return mCareBits == LowBits( mSpan );
+  }
+
+  // Reads the same backwards, so a reverse complemented word
+  // is made up of the same positions
+  bool IsSymmetric() const {
+    for( size_t pos = 0; pos < mSpan / 2; pos++ ) {
+      if( ( ( mCareBits >> pos ) & 1 ) !=
+          ( ( mCareBits >> ( mSpan - 1 - pos ) ) & 1 ) )
+        return false;
+    }
+    return true;
+  }
+
+  std::string ToString() const {
+    std::string pattern;
+    for( size_t pos = 0; pos < mSpan; pos++ ) {
+      pattern += ( mCareBits >> pos ) & 1 ? '1' : '0';
+    }
+    return pattern;
+  }
+
+private:
+  static uint64_t LowBits( const size_t numBits ) {
+    return numBits >= 64 ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << numBits ) - 1;
+  }
+
+  uint64_t mCareBits;
+  size_t   mSpan;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "../Alphabet.h"
+#include "../Sequence.h"
+#include "IndexArray.h"
+#include "IndexFile.h"
+#include "OffsetTable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/*
+ * Database sequences (identifiers and residues) in a few flat arrays.
+ * Residues are packed with PackPolicy< Alphabet >::NumBits each
+ * (2 bits for DNA). Residues which can't be packed (e.g. IUPAC codes)
+ * are kept in a sorted exception list. Quality scores are dropped.
+ */
+template < typename Alphabet >
+class SequenceStore {
+public:
+  static const size_t NumSections = 8;
+
+  void Initialize( const SequenceList< Alphabet >& sequences );
+
+  size_t NumSequences() const {
+    return mResidueOffsets.NumEntries();
+  }
+
+  size_t Length( const size_t seqId ) const {
+    return mResidueOffsets.Count( seqId );
+  }
+
+  // Random access to a single residue
+  char Residue( const size_t seqId, const size_t pos ) const;
+
+  // Decode whole sequence (reuses seq's buffers)
+  void Get( const size_t seqId, Sequence< Alphabet >* seq ) const;
+
+  // Memory (bytes) of each array
+  using ArrayCallback =
+    std::function< void( const std::string&, const size_t ) >;
+  void ForEachArray( const ArrayCallback& block ) const;
+
+  void Write( IndexFile::Writer* writer ) const;
+  bool Read( const IndexFile::Reader& reader, const size_t firstSection );
+
+private:
+  using Word = uint64_t;
+
+  static const size_t NumBits         = PackPolicy< Alphabet >::NumBits;
+  static const size_t ResiduesPerWord = sizeof( Word ) * 8 / NumBits;
+  static const Word   ResidueMask     = ( Word( 1 ) << NumBits ) - 1;
+
+  inline uint8_t Code( const size_t index ) const {
+    return ( mResidues[ index / ResiduesPerWord ] >>
+             ( index % ResiduesPerWord * NumBits ) ) &
+           ResidueMask;
+  }
+
+  IndexArray< char > mIdentifiers;
+  OffsetTable        mIdentifierOffsets;
+
+  IndexArray< Word > mResidues;
+  OffsetTable        mResidueOffsets;
+
+  // Global residue index and actual residue, sorted by index
+  IndexArray< uint64_t > mExceptionIndices;
+  IndexArray< char >     mExceptionResidues;
+};
+
+/*
+ * Implementation
+ */
+template < typename A >
+void SequenceStore< A >::Initialize( const SequenceList< A >& sequences ) {
+  size_t numIdentifierChars = 0, numResidues = 0, numExceptions = 0;
+  for( auto& seq : sequences ) {
+    numIdentifierChars += seq.identifier.size();
+    numResidues += seq.Length();
+
+    uint8_t code;
+    for( auto ch : seq.sequence ) {
+      if( !PackPolicy< A >::Pack( ch, &code ) )
+        numExceptions++;
+    }
+  }
+
+  mIdentifiers = IndexArray< char >( numIdentifierChars );
+  mIdentifierOffsets.Reset( sequences.size(), numIdentifierChars );
+  mResidues = IndexArray< Word >( ( numResidues + ResiduesPerWord - 1 ) /
+                                  ResiduesPerWord );
+  mResidueOffsets.Reset( sequences.size(), numResidues );
+  mExceptionIndices  = IndexArray< uint64_t >( numExceptions );
+  mExceptionResidues = IndexArray< char >( numExceptions );
+
+  size_t identifierOffset = 0, index = 0, exception = 0;
+  for( size_t seqId = 0; seqId < sequences.size(); seqId++ ) {
+    auto& seq = sequences[ seqId ];
+
+    mIdentifierOffsets.Set( seqId, identifierOffset );
+    std::copy( seq.identifier.begin(), seq.identifier.end(),
+               mIdentifiers.data() + identifierOffset );
+    identifierOffset += seq.identifier.size();
+
+    mResidueOffsets.Set( seqId, index );
+    for( auto ch : seq.sequence ) {
+      uint8_t code = 0;
+      if( !PackPolicy< A >::Pack( ch, &code ) ) {
+        mExceptionIndices[ exception ]  = index;
+        mExceptionResidues[ exception ] = ch;
+        exception++;
+      }
+
+      mResidues[ index / ResiduesPerWord ] |=
+        Word( code ) << ( index % ResiduesPerWord * NumBits );
+      index++;
+    }
+  }
+  mIdentifierOffsets.Set( sequences.size(), identifierOffset );
+  mResidueOffsets.Set( sequences.size(), index );
+}
+
+template < typename A >
+char SequenceStore< A >::Residue( const size_t seqId, const size_t pos ) const {
+  assert( pos < Length( seqId ) );
+  size_t index = mResidueOffsets.Begin( seqId ) + pos;
+
+  auto begin = mExceptionIndices.data();
+  auto end   = begin + mExceptionIndices.size();
+  auto it    = std::lower_bound( begin, end, index );
+  if( it != end && *it == index )
+    return mExceptionResidues[ it - begin ];
+
+  return PackPolicy< A >::Unpack( Code( index ) );
+}
+
+template < typename A >
+void SequenceStore< A >::Get( const size_t seqId, Sequence< A >* seq ) const {
+  assert( seqId < NumSequences() );
+
+  size_t identifierBegin = mIdentifierOffsets.Begin( seqId );
+  seq->identifier.assign( mIdentifiers.data() + identifierBegin,
+                          mIdentifierOffsets.End( seqId ) - identifierBegin );
+  seq->quality.clear();
+
+  size_t first = mResidueOffsets.Begin( seqId );
+  size_t last  = mResidueOffsets.End( seqId );
+
+  seq->sequence.resize( last - first );
+  char* out = &seq->sequence[ 0 ];
+  for( size_t index = first; index < last; index++ ) {
+    *out++ = PackPolicy< A >::Unpack( Code( index ) );
+  }
+
+  // Patch in exceptions
+  auto begin = mExceptionIndices.data();
+  auto end   = begin + mExceptionIndices.size();
+  for( auto it = std::lower_bound( begin, end, first ); it != end && *it < last;
+       ++it ) {
+    seq->sequence[ *it - first ] = mExceptionResidues[ it - begin ];
+  }
+}
+
+template < typename A >
+void SequenceStore< A >::ForEachArray( const ArrayCallback& block ) const {
+  block( "Identifiers", mIdentifiers.NumBytes() );
+  block( "Identifier offsets", mIdentifierOffsets.NumBytes() );
+  block( "Residues", mResidues.NumBytes() );
+  block( "Residue offsets", mResidueOffsets.NumBytes() );
+  block( "Residue exceptions",
+         mExceptionIndices.NumBytes() + mExceptionResidues.NumBytes() );
+}
+
+template < typename A >
+void SequenceStore< A >::Write( IndexFile::Writer* writer ) const {
+  writer->Add( mIdentifiers );
+  writer->Add( mIdentifierOffsets.Narrow() );
+  writer->Add( mIdentifierOffsets.Wide() );
+  writer->Add( mResidues );
+  writer->Add( mResidueOffsets.Narrow() );
+  writer->Add( mResidueOffsets.Wide() );
+  writer->Add( mExceptionIndices );
+  writer->Add( mExceptionResidues );
+}
+
+template < typename A >
+bool SequenceStore< A >::Read( const IndexFile::Reader& reader,
+                               const size_t             firstSection ) {
+  size_t section = firstSection;
+  if( !reader.Get( section++, &mIdentifiers ) ||
+      !reader.Get( section++, &mIdentifierOffsets.Narrow() ) ||
+      !reader.Get( section++, &mIdentifierOffsets.Wide() ) ||
+      !reader.Get( section++, &mResidues ) ||
+      !reader.Get( section++, &mResidueOffsets.Narrow() ) ||
+      !reader.Get( section++, &mResidueOffsets.Wide() ) ||
+      !reader.Get( section++, &mExceptionIndices ) ||
+      !reader.Get( section++, &mExceptionResidues ) )
+    return false;
+
+  size_t numSequences = NumSequences();
+  if( mIdentifierOffsets.NumEntries() != numSequences ||
+      !mIdentifierOffsets.IsValid( mIdentifiers.size() ) ||
+      !mResidueOffsets.IsValid( mResidues.size() * ResiduesPerWord ) ||
+      mExceptionIndices.size() != mExceptionResidues.size() )
+    return false;
+
+  // Exceptions are looked up by binary search
+  for( size_t exception = 0; exception < mExceptionIndices.size();
+       exception++ ) {
+    if( mExceptionIndices[ exception ] >= mResidueOffsets.Total() ||
+        ( exception > 0 && mExceptionIndices[ exception ] <=
+                             mExceptionIndices[ exception - 1 ] ) )
+      return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+/*
+ * Read-only view of a whole file.
+ * Uses mmap where available, so the pages are shared between processes
+ * mapping the same file and are only loaded on first access.
+ */
+class MappedFile {
+public:
+  MappedFile( const std::string& fileName );
+  ~MappedFile();
+
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+
+  bool IsOpen() const;
+
+  const char* Data() const;
+  size_t      Size() const;
+
+private:
+  const char* mData;
+  size_t      mSize;
+  bool        mMapped;
+};
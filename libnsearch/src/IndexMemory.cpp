@@ -0,0 +1,80 @@
+#include "nsearch/Database/IndexMemory.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+static IndexMemoryPolicy gPolicy;
+
+static const size_t HugePageSize = size_t( 2 ) << 20;
+
+// Mappings are whole huge pages, so any of them can be huge
+static size_t MappingSize( const size_t numBytes ) {
+  return ( numBytes + HugePageSize - 1 ) / HugePageSize * HugePageSize;
+}
+
+namespace IndexMemory {
+
+void SetPolicy( const IndexMemoryPolicy& policy ) {
+  gPolicy = policy;
+}
+
+const IndexMemoryPolicy& Policy() {
+  return gPolicy;
+}
+
+void* Allocate( const size_t numBytes ) {
+#ifdef _WIN32
+  return ::operator new( numBytes );
+#else
+  const size_t size = MappingSize( numBytes );
+
+  void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if( gPolicy.reservedHugePages ) {
+    addr = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+  }
+#endif
+
+  if( addr == MAP_FAILED ) {
+    addr = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( addr == MAP_FAILED )
+      throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    if( gPolicy.hugePages ) {
+      madvise( addr, size, MADV_HUGEPAGE );
+    }
+#endif
+  }
+
+#if defined( __linux__ ) && defined( SYS_mbind )
+  // Before the pages are touched. The kernel only uses the nodes
+  // present (and allowed), so all of the first 64 are listed.
+  if( gPolicy.interleave ) {
+    const int           MpolInterleave = 3;
+    const unsigned long nodeMask       = ~0UL;
+    syscall( SYS_mbind, addr, size, MpolInterleave, &nodeMask,
+             sizeof( nodeMask ) * 8 + 1, 0 );
+  }
+#endif
+
+  return addr;
+#endif
+}
+
+void Free( void* ptr, const size_t numBytes ) {
+#ifdef _WIN32
+  ::operator delete( ptr );
+#else
+  munmap( ptr, MappingSize( numBytes ) );
+#endif
+}
+
+} // namespace IndexMemory
@@ -0,0 +1,80 @@
+#include "nsearch/MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include "winstd.h"
+#endif
+
+MappedFile::MappedFile( const std::string& fileName )
+    : mData( NULL ), mSize( 0 ), mMapped( false ) {
+  int fd = open( fileName.c_str(), O_RDONLY );
+  if( fd == -1 )
+    return;
+
+  struct stat st;
+  if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) {
+    close( fd );
+    return;
+  }
+  mSize = st.st_size;
+
+#ifndef _WIN32
+  void* addr = mmap( NULL, mSize, PROT_READ, MAP_SHARED, fd, 0 );
+  if( addr != MAP_FAILED ) {
+    mData   = ( const char* ) addr;
+    mMapped = true;
+  }
+#endif
+
+  if( !mMapped ) {
+    // No mmap, fall back to reading the whole file
+    char*  buffer   = new char[ mSize ];
+    size_t numTotal = 0;
+    while( numTotal < mSize ) {
+      auto numRead = read( fd, buffer + numTotal, mSize - numTotal );
+      if( numRead <= 0 )
+        break;
+      numTotal += numRead;
+    }
+
+    if( numTotal == mSize ) {
+      mData = buffer;
+    } else {
+      delete[] buffer;
+      mSize = 0;
+    }
+  }
+
+  close( fd );
+}
+
+MappedFile::~MappedFile() {
+  if( !mData )
+    return;
+
+#ifndef _WIN32
+  if( mMapped ) {
+    munmap( ( void* ) mData, mSize );
+    return;
+  }
+#endif
+
+  delete[] mData;
+}
+
+bool MappedFile::IsOpen() const {
+  return mData != NULL;
+}
+
+const char* MappedFile::Data() const {
+  return mData;
+}
+
+size_t MappedFile::Size() const {
+  return mSize;
+}
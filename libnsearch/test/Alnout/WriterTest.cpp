@@ -87,13 +87,13 @@ TEST_CASE( "Alnout" ) {
   SECTION( "Protein" ) {
     auto entry1 = std::make_pair( Sequence< Protein >( "query1", "LAFQGVRN" ),
                                   HitList< Protein >( {
-                                    { { "target50", "MAFQGVRS" }, "1X6=1X" },
-                                    { { "target114", "LAGQGSAN" }, "4=3X1=" },
+                                    { { "target50", "MAFQGVRS" }, "1X6=1X", false },
+                                    { { "target114", "LAGQGSAN" }, "4=3X1=", false },
                                   } ) );
     auto entry2 =
       std::make_pair( Sequence< Protein >( "query2", "GGGGGYFDEATGVCPF" ),
                       HitList< Protein >( {
-                        { { "target1337", "YFDEATGICPFQQQ" }, "5I7=1X3=3D" },
+                        { { "target1337", "YFDEATGICPFQQQ" }, "5I7=1X3=3D", false },
                       } ) );
 
 
@@ -117,7 +117,8 @@ TEST_CASE( "Alnout" ) {
             "novemcinctus (nine-banded armadillo)",
             "CGUCACCUGAACUCAUGACUCUUCAACUUCAGGACUUGCAGAAUUAAUGGAAUGCCGUCCUAAGGU"
             "UGUUGAGUUCUGCGUUUCUGGGC" },
-          "1=1X1=2X7=1X2=1X11=1X17=2X1=1X29=1X4=3X3=" },
+          "1=1X1=2X7=1X2=1X11=1X17=2X1=1X29=1X4=3X3=", DNA::Strand::Plus,
+          false },
       } ) );
 
     std::ostringstream oss;
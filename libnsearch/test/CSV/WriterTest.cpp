@@ -13,7 +13,8 @@ TEST_CASE( "CSV" ) {
   auto entry = std::make_pair(
     Sequence< DNA >( "Query,1", "ATCGTGTACCAGGATG" ),
     HitList< DNA >( {
-      { { "Ref,1", "TTTATCGTGTCCCACCAGGATGTTT" }, "3D7=3D9=3D", DNA::Strand::Plus },
+      { { "Ref,1", "TTTATCGTGTCCCACCAGGATGTTT" }, "3D7=3D9=3D", DNA::Strand::Plus,
+        false },
       /*
        *
        *   ATCGTGTACCAGGATG (Query +Strand)
@@ -22,7 +23,8 @@ TEST_CASE( "CSV" ) {
        * TTCATCCTCGTACACGA- (Database +Strand)
        *
        */
-      { { "Ref2", "TTCATCCTCGTACACGA" }, "2D6=1X8=1I", DNA::Strand::Minus },
+      { { "Ref2", "TTCATCCTCGTACACGA" }, "2D6=1X8=1I", DNA::Strand::Minus,
+        false },
     } ) );
 
   std::ostringstream oss;
@@ -30,4 +32,12 @@ TEST_CASE( "CSV" ) {
 
   writer << entry;
   REQUIRE( oss.str() == CSVOutput );
+
+  SECTION( "Header for each output" ) {
+    std::ostringstream other;
+    CSV::Writer< DNA > otherWriter( other );
+
+    otherWriter << entry;
+    REQUIRE( other.str() == CSVOutput );
+  }
 }
@@ -0,0 +1,64 @@
+#include <catch.hpp>
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Database/DustMasker.h>
+
+#include <vector>
+
+#include "../Support.h"
+
+TEST_CASE( "DustMasker" ) {
+  DustMasker< DNA > masker;
+  MaskedRegions     regions;
+
+  SECTION( "Complex sequence" ) {
+    masker.Mask( "TGCATGACGCTAGCTTAGCAATCGGACTTGACCATGTACGGACTTAGCGATCAGG",
+                 &regions );
+    REQUIRE( regions.empty() );
+  }
+
+  SECTION( "Homopolymer" ) {
+    masker.Mask( "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA", &regions );
+    REQUIRE( regions.size() == 1 );
+    REQUIRE( regions[ 0 ].first == 0 );
+    REQUIRE( regions[ 0 ].second == 30 );
+  }
+
+  SECTION( "Repeat within complex sequence" ) {
+    std::string left  = "TGCATGACGCTAGCTTAGCAATCGG";
+    std::string right = "ACTTGACCATGTACGGACTTAGCGA";
+    std::string seq   = left;
+    for( int i = 0; i < 20; i++ ) {
+      seq += "AT";
+    }
+    seq += right;
+
+    masker.Mask( seq, &regions );
+    REQUIRE( regions.size() == 1 );
+    REQUIRE( regions[ 0 ].first >= left.size() - 2 );
+    REQUIRE( regions[ 0 ].first <= left.size() );
+    REQUIRE( regions[ 0 ].second >= left.size() + 40 );
+    REQUIRE( regions[ 0 ].second <= left.size() + 42 );
+  }
+
+  SECTION( "Ambiguous residues split the sequence" ) {
+    masker.Mask( "AAAAAAAAAAAAAAAANCCCCCCCCCCCCCCCCC", &regions );
+    REQUIRE( regions.size() == 2 );
+    REQUIRE( regions[ 0 ].second <= 16 );
+    REQUIRE( regions[ 1 ].first >= 17 );
+  }
+
+  SECTION( "Kmers skip masked regions" ) {
+    Sequence< DNA > seq = "ACGTACGT";
+    regions             = { { 2, 3 } };
+
+    std::vector< Kmer > kmers;
+    Kmers< DNA >( seq, SeedMask( 4 ), &regions )
+      .ForEach( [&]( Kmer kmer, size_t ) { kmers.push_back( kmer ); } );
+    REQUIRE( kmers.size() == 5 );
+    REQUIRE( kmers[ 0 ] == AmbiguousKmer );
+    REQUIRE( kmers[ 2 ] == AmbiguousKmer );
+    REQUIRE( kmers[ 3 ] == Kmerify( "TACG" ) );
+    REQUIRE( kmers[ 4 ] == Kmerify( "ACGT" ) );
+  }
+}
@@ -0,0 +1,152 @@
+#include <catch.hpp>
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Database.h>
+#include <nsearch/Database/GlobalSearch.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// Allocations of the current thread, counted while enabled. Every
+// (non-aligned) variant is replaced, so new and delete always match.
+static thread_local bool   gCountAllocations = false;
+static thread_local size_t gNumAllocations   = 0;
+
+static void* Allocate( const size_t size ) noexcept {
+  if( gCountAllocations ) {
+    gNumAllocations++;
+  }
+
+  return malloc( size ? size : 1 );
+}
+
+void* operator new( size_t size ) {
+  void* ptr = Allocate( size );
+  if( !ptr )
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[]( size_t size ) {
+  return operator new( size );
+}
+
+void* operator new( size_t size, const std::nothrow_t& ) noexcept {
+  return Allocate( size );
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept {
+  return Allocate( size );
+}
+
+void operator delete( void* ptr ) noexcept {
+  free( ptr );
+}
+
+void operator delete[]( void* ptr ) noexcept {
+  free( ptr );
+}
+
+void operator delete( void* ptr, size_t ) noexcept {
+  free( ptr );
+}
+
+void operator delete[]( void* ptr, size_t ) noexcept {
+  free( ptr );
+}
+
+void operator delete( void* ptr, const std::nothrow_t& ) noexcept {
+  free( ptr );
+}
+
+void operator delete[]( void* ptr, const std::nothrow_t& ) noexcept {
+  free( ptr );
+}
+
+template < typename F >
+static size_t CountAllocations( const F& f ) {
+  gNumAllocations   = 0;
+  gCountAllocations = true;
+  f();
+  gCountAllocations = false;
+  return gNumAllocations;
+}
+
+// Random residues of two kinds, never more than three the same in a row
+static std::string RandomResidues( const char* kinds, const size_t length,
+                                   uint32_t* random ) {
+  std::string residues;
+  for( size_t i = 0; i < length; i++ ) {
+    *random = *random * 1103515245 + 12345;
+    char residue = kinds[ ( *random >> 16 ) & 1 ];
+    if( i >= 3 && residues[ i - 1 ] == residue &&
+        residues[ i - 2 ] == residue && residues[ i - 3 ] == residue ) {
+      residue = kinds[ kinds[ 0 ] == residue ];
+    }
+    residues += residue;
+  }
+  return residues;
+}
+
+TEST_CASE( "Global Search Allocations" ) {
+  // No kmer of the queries (A/G) or their reverse complement (C/T) is
+  // in the database (A/C), so the queries have no candidates
+  uint32_t            random = 7;
+  SequenceList< DNA > sequences;
+  for( size_t i = 0; i < 50; i++ ) {
+    sequences.push_back( Sequence< DNA >( std::to_string( i ),
+                                          RandomResidues( "AC", 200, &random ) ) );
+  }
+
+  Sequence< DNA > longQuery( "long", RandomResidues( "AG", 2000, &random ) );
+  Sequence< DNA > shortQuery( "short", RandomResidues( "AG", 300, &random ) );
+
+  SearchParams< DNA > sp;
+  sp.minIdentity = 0.9f;
+  sp.strand      = DNA::Strand::Both;
+
+  // Only the (empty) hit list returned is allocated
+  const size_t numExpected =
+    CountAllocations( []() { HitList< DNA > hits; } );
+
+  auto check = [&]( const size_t wordSize, const DatabaseParams& params ) {
+    Database< DNA > db( wordSize, params );
+    db.Initialize( sequences );
+    GlobalSearch< DNA > search( db, sp );
+
+    // Scratch buffers grow to the longest query, and hit counters are
+    // allocated once for each counter width (short queries use narrower ones)
+    REQUIRE( search.Query( longQuery ).empty() );
+    REQUIRE( search.Query( shortQuery ).empty() );
+    REQUIRE( CountAllocations( [&]() { search.Query( longQuery ); } ) ==
+             numExpected );
+    REQUIRE( CountAllocations( [&]() { search.Query( shortQuery ); } ) ==
+             numExpected );
+  };
+
+  DatabaseParams params;
+
+  SECTION( "Direct index" ) {
+    check( 12, params );
+  }
+
+  SECTION( "Sorted index" ) {
+    check( 14, params );
+  }
+
+  SECTION( "Canonical kmers" ) {
+    params.canonicalKmers = true;
+    check( 12, params );
+  }
+
+  SECTION( "Minimizers" ) {
+    params.minimizerWindow = 8;
+    check( 12, params );
+  }
+
+  SECTION( "Masked" ) {
+    params.dustMask = true;
+    check( 12, params );
+  }
+}
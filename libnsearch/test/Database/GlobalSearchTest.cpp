@@ -5,6 +5,7 @@
 #include <nsearch/Database/GlobalSearch.h>
 #include <nsearch/FASTA/Reader.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -92,6 +93,21 @@ TEST_CASE( "Global Search" ) {
     REQUIRE( hits[ 0 ].target.identifier == "RF00807;mir-314;AFFE01007792.1/82767-82854   42026:Drosophila bipectinata" );
   }
 
+  SECTION( "Consecutive queries" ) {
+    // Hit counts of one query don't carry over to the next
+    GlobalSearch< DNA > gs( db, sp );
+    auto first = gs.Query( query );
+
+    for( auto& seq : sequences ) {
+      gs.Query( seq );
+    }
+
+    auto again = gs.Query( query );
+    REQUIRE( again.size() == first.size() );
+    REQUIRE( again[ 0 ].target.identifier == first[ 0 ].target.identifier );
+    REQUIRE( again[ 0 ].alignment == first[ 0 ].alignment );
+  }
+
   SECTION( "Min Identity" ) {
     sp.minIdentity = 0.9f;
 
@@ -148,4 +164,194 @@ TEST_CASE( "Global Search" ) {
       REQUIRE( hits[ 0 ].strand == DNA::Strand::Minus );
     }
   }
+
+  SECTION( "Minimizers" ) {
+    DatabaseParams params;
+    params.minimizerWindow = 6;
+    Database< DNA > sampledDB( 8, params );
+    sampledDB.Initialize( sequences );
+
+    GlobalSearch< DNA > gs( sampledDB, sp );
+    auto hits = gs.Query( query );
+    REQUIRE( hits.size() == 1 );
+    REQUIRE( hits[ 0 ].target.identifier == "RF00807;mir-314;AFFE01007792.1/82767-82854   42026:Drosophila bipectinata" );
+  }
+
+  SECTION( "Canonical kmers" ) {
+    DatabaseParams params;
+    params.canonicalKmers = true;
+    Database< DNA > canonicalDB( 8, params );
+    canonicalDB.Initialize( sequences );
+
+    sp.strand = DNA::Strand::Both;
+    GlobalSearch< DNA > gs( canonicalDB, sp );
+
+    auto hits = gs.Query( query );
+    REQUIRE( hits.size() == 1 );
+    REQUIRE( hits[ 0 ].strand == DNA::Strand::Plus );
+    REQUIRE( hits[ 0 ].target.identifier == "RF00807;mir-314;AFFE01007792.1/82767-82854   42026:Drosophila bipectinata" );
+
+    hits = gs.Query( query.Reverse().Complement() );
+    REQUIRE( hits.size() == 1 );
+    REQUIRE( hits[ 0 ].strand == DNA::Strand::Minus );
+
+    sp.strand = DNA::Strand::Plus;
+    GlobalSearch< DNA > plus( canonicalDB, sp );
+    REQUIRE( plus.Query( query.Reverse().Complement() ).size() == 0 );
+  }
+
+  SECTION( "Collapsed duplicates" ) {
+    SequenceList< DNA > withCopy = sequences;
+    withCopy.push_back( sequences[ 0 ] );
+    withCopy.back().identifier = "copy";
+
+    DatabaseParams params;
+    params.collapseDuplicates = true;
+    Database< DNA > collapsedDB( 8, params );
+    collapsedDB.Initialize( withCopy );
+    REQUIRE( collapsedDB.NumSequences() == sequences.size() );
+
+    GlobalSearch< DNA > gs( collapsedDB, sp );
+    auto hits = gs.Query( query );
+    REQUIRE( hits.size() == 2 );
+    REQUIRE( hits[ 0 ].target.identifier == "RF00807;mir-314;AFFE01007792.1/82767-82854   42026:Drosophila bipectinata" );
+    REQUIRE( hits[ 1 ].target.identifier == "copy" );
+    REQUIRE( hits[ 1 ].alignment == hits[ 0 ].alignment );
+    REQUIRE( !hits[ 0 ].duplicate );
+    REQUIRE( hits[ 1 ].duplicate );
+  }
+
+  SECTION( "Length pruning" ) {
+    // Query is 76 long, the best hit 88
+    sp.minLengthRatio = 0.9f;
+
+    GlobalSearch< DNA > unsortedSearch( db, sp );
+    REQUIRE( unsortedSearch.Query( query ).size() == 0 );
+
+    DatabaseParams params;
+    params.sortByLength = true;
+    Database< DNA > sortedDB( 8, params );
+    sortedDB.Initialize( sequences );
+
+    GlobalSearch< DNA > sortedSearch( sortedDB, sp );
+    REQUIRE( sortedSearch.Query( query ).size() == 0 );
+
+    sp.minLengthRatio = 0.8f;
+    GlobalSearch< DNA > looseSearch( sortedDB, sp );
+    auto hits = looseSearch.Query( query );
+    REQUIRE( hits.size() == 1 );
+    REQUIRE( hits[ 0 ].target.identifier == "RF00807;mir-314;AFFE01007792.1/82767-82854   42026:Drosophila bipectinata" );
+  }
+
+  SECTION( "Sharded search" ) {
+    // Searching two halves of the database and merging the hits finds
+    // as many hits as searching all of it, with the identical sequences
+    // spread over both halves
+    SequenceList< DNA > withCopies = sequences;
+    for( int i = 0; i < 3; i++ ) {
+      withCopies.insert( withCopies.begin() + 1, sequences[ 0 ] );
+      withCopies[ 1 ].identifier = "copy " + std::to_string( i );
+    }
+
+    SequenceList< DNA > halves[ 2 ];
+    for( size_t i = 0; i < withCopies.size(); i++ ) {
+      halves[ i % 2 ].push_back( withCopies[ i ] );
+    }
+
+    sp.strand      = DNA::Strand::Both;
+    sp.minIdentity = 0.6f;
+    sp.maxAccepts  = 2;
+
+    auto numDuplicates = []( const HitList< DNA >& hits ) {
+      return std::count_if( hits.begin(), hits.end(),
+                            []( const Hit< DNA >& hit ) { return hit.duplicate; } );
+    };
+
+    auto compare = [&]( const DatabaseParams& params ) {
+      Database< DNA > whole( 8, params ), first( 8, params ),
+        second( 8, params );
+      whole.Initialize( withCopies );
+      first.Initialize( halves[ 0 ] );
+      second.Initialize( halves[ 1 ] );
+
+      GlobalSearch< DNA > wholeSearch( whole, sp ), firstSearch( first, sp ),
+        secondSearch( second, sp );
+      for( auto& seq : { sequences[ 0 ], query } ) {
+        auto expected = wholeSearch.Query( seq );
+
+        HitList< DNA > merged;
+        MergeHits( firstSearch.Query( seq ), sp.maxAccepts,
+                   params.collapseDuplicates, &merged );
+        MergeHits( secondSearch.Query( seq ), sp.maxAccepts,
+                   params.collapseDuplicates, &merged );
+        REQUIRE( merged.size() == expected.size() );
+        REQUIRE( numDuplicates( merged ) == numDuplicates( expected ) );
+
+        // The same hits, by target id (the halves interleave)
+        auto firstById  = firstSearch.QueryById( seq );
+        auto secondById = secondSearch.QueryById( seq );
+        for( auto& hit : firstById ) {
+          hit.targetId = 2 * hit.targetId;
+        }
+        for( auto& hit : secondById ) {
+          hit.targetId = 2 * hit.targetId + 1;
+        }
+
+        HitByIdList< DNA > mergedById;
+        MergeHits( firstById, sp.maxAccepts, params.collapseDuplicates,
+                   &mergedById );
+        MergeHits( secondById, sp.maxAccepts, params.collapseDuplicates,
+                   &mergedById );
+
+        REQUIRE( mergedById.size() == merged.size() );
+        for( size_t i = 0; i < merged.size(); i++ ) {
+          auto& hit = mergedById[ i ];
+          REQUIRE( withCopies[ hit.targetId ] == merged[ i ].target );
+          REQUIRE( withCopies[ hit.targetId ].identifier ==
+                   merged[ i ].target.identifier );
+          REQUIRE( hit.alignment == merged[ i ].alignment );
+          REQUIRE( hit.strand == merged[ i ].strand );
+          REQUIRE( hit.duplicate == merged[ i ].duplicate );
+        }
+      }
+    };
+
+    SECTION( "Without collapsed duplicates" ) {
+      compare( DatabaseParams() );
+    }
+
+    SECTION( "With collapsed duplicates" ) {
+      DatabaseParams params;
+      params.collapseDuplicates = true;
+      compare( params );
+    }
+  }
+}
+
+TEST_CASE( "Global Search Long Query" ) {
+  // More shared kmers than 16-bit counters can count
+  std::string residues;
+  uint32_t    random = 42;
+  for( size_t i = 0; i < 80000; i++ ) {
+    random = random * 1103515245 + 12345;
+    residues += "ACGT"[ ( random >> 16 ) & 3 ];
+  }
+
+  SequenceList< DNA > sequences;
+  sequences.push_back( Sequence< DNA >( "full", residues ) );
+  sequences.push_back( Sequence< DNA >( "part", residues.substr( 0, 20000 ) ) );
+
+  Database< DNA > db( 12 );
+  db.Initialize( sequences );
+
+  SearchParams< DNA > sp;
+  sp.maxAccepts  = 1;
+  sp.maxRejects  = 1;
+  sp.minIdentity = 0.9f;
+
+  // Wrapped counts would rank the part first (and reject it)
+  GlobalSearch< DNA > gs( db, sp );
+  auto hits = gs.Query( sequences[ 0 ] );
+  REQUIRE( hits.size() == 1 );
+  REQUIRE( hits[ 0 ].target.identifier == "full" );
 }
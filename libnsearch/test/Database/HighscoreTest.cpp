@@ -0,0 +1,123 @@
+#include <catch.hpp>
+
+#include <nsearch/Database/Highscore.h>
+
+#include <vector>
+
+// Ids of the entries kept, highest score first
+static std::vector< size_t > Ids( const Highscore& highscore ) {
+  std::vector< size_t > ids;
+  for( auto& entry : highscore.EntriesFromTopToBottom() ) {
+    ids.push_back( entry.id );
+  }
+  return ids;
+}
+
+TEST_CASE( "Highscore" ) {
+  Highscore highscore( 3 );
+
+  SECTION( "Keeps the highest scores" ) {
+    // Scores go up one at a time, like hit counters
+    for( size_t score = 1; score <= 5; score++ ) {
+      highscore.Set( 7, score );
+    }
+    for( size_t score = 1; score <= 2; score++ ) {
+      highscore.Set( 3, score );
+    }
+    highscore.Set( 9, 1 );
+    for( size_t score = 1; score <= 4; score++ ) {
+      highscore.Set( 1, score );
+    }
+
+    // 9 (1) drops out once all are taken and 1 scores higher
+    REQUIRE( Ids( highscore ) == std::vector< size_t >( { 7, 1, 3 } ) );
+
+    auto entries = highscore.EntriesFromTopToBottom();
+    REQUIRE( entries[ 0 ].score == 5 );
+    REQUIRE( entries[ 2 ].score == 2 );
+  }
+
+  SECTION( "Ties" ) {
+    highscore.Set( 5, 1 );
+    highscore.Set( 4, 1 );
+    highscore.Set( 6, 1 );
+
+    // Equal scores don't displace an entry (the first inserted stays).
+    // Equal scores are listed from the last slot to the first.
+    highscore.Set( 8, 1 );
+    REQUIRE( Ids( highscore ) == std::vector< size_t >( { 6, 4, 5 } ) );
+
+    // Takes the first slot with the lowest score
+    highscore.Set( 8, 2 );
+    REQUIRE( Ids( highscore ) == std::vector< size_t >( { 8, 6, 4 } ) );
+  }
+
+  SECTION( "Evicted id re-entering" ) {
+    highscore.Set( 1, 1 );
+    highscore.Set( 2, 1 );
+    highscore.Set( 3, 1 );
+    highscore.Set( 1, 2 );
+
+    // 4 evicts 2, the first slot scoring lower
+    highscore.Set( 4, 1 );
+    highscore.Set( 4, 2 );
+    REQUIRE( Ids( highscore ) == std::vector< size_t >( { 4, 1, 3 } ) );
+
+    SECTION( "One higher" ) {
+      highscore.Set( 2, 2 );
+      REQUIRE( Ids( highscore ) == std::vector< size_t >( { 2, 4, 1 } ) );
+    }
+
+    SECTION( "Higher than the slot it takes" ) {
+      // Takes the first slot scoring lower (1's), not the lowest one (3's)
+      highscore.Set( 2, 3 );
+      REQUIRE( Ids( highscore ) == std::vector< size_t >( { 2, 4, 3 } ) );
+    }
+  }
+
+  SECTION( "Tie order of many entries" ) {
+    // Order (and ids kept) as with the original linear slot scan, which
+    // search results depend on
+    Highscore many( 17 );
+    size_t    counts[ 30 ] = { 0 };
+    for( size_t round = 1; round <= 3; round++ ) {
+      for( size_t id = 0; id < 30; id++ ) {
+        if( ( id * 7 + round ) % 3 != 0 ) {
+          many.Set( id, ++counts[ id ] );
+        }
+      }
+    }
+
+    REQUIRE( Ids( many ) ==
+             std::vector< size_t >( { 27, 3, 1, 6, 2, 9, 4, 0, 5, 15, 7, 18,
+                                      8, 21, 10, 24, 12 } ) );
+  }
+
+  SECTION( "Reset" ) {
+    highscore.Set( 2, 1 );
+    highscore.Set( 2, 2 );
+    highscore.Reset( 1 );
+    REQUIRE( highscore.EntriesFromTopToBottom().empty() );
+
+    highscore.Set( 1, 1 );
+    highscore.Set( 2, 1 );
+    REQUIRE( Ids( highscore ) == std::vector< size_t >( { 1 } ) );
+  }
+
+  SECTION( "Many entries" ) {
+    Highscore many( 256 );
+    for( size_t id = 0; id < 1000; id++ ) {
+      for( size_t score = 1; score <= id % 300 + 1; score++ ) {
+        many.Set( id, score );
+      }
+    }
+
+    auto entries = many.EntriesFromTopToBottom();
+    REQUIRE( entries.size() == 256 );
+    REQUIRE( entries.front().score == 300 );
+    for( size_t i = 1; i < entries.size(); i++ ) {
+      REQUIRE( entries[ i - 1 ].score >= entries[ i ].score );
+    }
+    REQUIRE( entries.back().score == 300 - 85 );
+  }
+}
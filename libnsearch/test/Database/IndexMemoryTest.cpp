@@ -0,0 +1,42 @@
+#include <catch.hpp>
+
+#include <nsearch/Database/IndexArray.h>
+#include <nsearch/Database/IndexMemory.h>
+
+#include <cstdint>
+
+TEST_CASE( "IndexMemory" ) {
+  IndexMemoryPolicy policy;
+  SECTION( "Default" ) {}
+  SECTION( "Huge pages" ) {
+    policy.hugePages = true;
+  }
+  SECTION( "Reserved huge pages" ) {
+    policy.reservedHugePages = true;
+  }
+  SECTION( "Interleaved" ) {
+    policy.interleave = true;
+  }
+  IndexMemory::SetPolicy( policy );
+
+  // Large enough to follow the policy, small ones are allocated as usual
+  const size_t size = IndexMemory::MinPolicySize / sizeof( uint32_t ) + 3;
+
+  IndexArray< uint32_t > array( size );
+  REQUIRE( array.size() == size );
+  REQUIRE( array[ 0 ] == 0 );
+  REQUIRE( array[ size - 1 ] == 0 );
+
+  array[ size - 1 ] = 42;
+  array.resize( 2 * size, 7 );
+  REQUIRE( array[ size - 1 ] == 42 );
+  REQUIRE( array[ 2 * size - 1 ] == 7 );
+
+  IndexArray< uint32_t > copy = array;
+  REQUIRE( copy[ size - 1 ] == 42 );
+
+  IndexArray< uint8_t > small( 16, 1 );
+  REQUIRE( small[ 15 ] == 1 );
+
+  IndexMemory::SetPolicy( IndexMemoryPolicy() );
+}
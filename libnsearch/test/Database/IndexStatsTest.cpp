@@ -0,0 +1,90 @@
+#include <catch.hpp>
+
+#include <nsearch/Database/IndexStats.h>
+#include <nsearch/Alphabet/DNA.h>
+
+#include "../Support.h"
+
+TEST_CASE( "IndexStats" ) {
+  SequenceList< DNA > sequences = {
+    Sequence< DNA >( "seq1", "AAAACCCC" ),
+    Sequence< DNA >( "seq2", "AAAAGGGG" ),
+    Sequence< DNA >( "seq3", "AAAANTTT" ),
+  };
+
+  Database< DNA > db( 4 );
+  db.Initialize( sequences );
+
+  IndexStats< DNA > stats( db, 2 );
+
+  SECTION( "Memory" ) {
+    size_t total = 0;
+    for( auto& array : stats.arrays ) {
+      total += array.second;
+    }
+    REQUIRE( total == stats.totalBytes );
+    REQUIRE( stats.totalBytes > 0 );
+  }
+
+  SECTION( "Posting lists" ) {
+    REQUIRE( stats.numSequences == 3 );
+    REQUIRE( stats.numResidues == 24 );
+
+    // AAAA (3), AAAC, AACC, ACCC, CCCC, AAAG, AAGG, AGGG, GGGG (1)
+    REQUIRE( stats.numKmers == 9 );
+    REQUIRE( stats.numPostings == 11 );
+    REQUIRE( stats.maxPostingListLength == 3 );
+
+    REQUIRE( stats.postingListLengths.size() == 2 );
+    REQUIRE( stats.postingListLengths[ 0 ] == 8 );
+    REQUIRE( stats.postingListLengths[ 1 ] == 1 );
+
+    REQUIRE( stats.topKmers.size() == 2 );
+    REQUIRE( stats.topKmers[ 0 ].first == Kmerify( "AAAA" ) );
+    REQUIRE( stats.topKmers[ 0 ].second == 3 );
+    REQUIRE( stats.topKmers[ 1 ].second == 1 );
+  }
+
+  SECTION( "Ambiguous kmers" ) {
+    // 5 kmers per sequence, 4 of seq3 overlap the N
+    REQUIRE( stats.numSequenceKmers == 15 );
+    REQUIRE( stats.numAmbiguousKmers == 4 );
+    REQUIRE( stats.AmbiguousKmerFraction() == Approx( 4.0 / 15.0 ) );
+  }
+
+  SECTION( "Counting cost" ) {
+    // Database sequences: 7 postings (5 lookups) each for seq1 and seq2,
+    // 3 (1 lookup) for seq3
+    REQUIRE( stats.numCostQueries == 3 );
+    REQUIRE( stats.meanLookupsPerQuery == Approx( 11.0 / 3.0 ) );
+    REQUIRE( stats.meanCountingCost == Approx( 17.0 / 3.0 ) );
+
+    // Too few sequences to reset them one by one
+    REQUIRE( stats.meanCountersReset == Approx( 3.0 ) );
+
+    stats.MeasureCountingCost( { Sequence< DNA >( "query", "AAAACC" ) } );
+    REQUIRE( stats.numCostQueries == 1 );
+    REQUIRE( stats.meanLookupsPerQuery == Approx( 3.0 ) );
+    REQUIRE( stats.meanCountingCost == Approx( 5.0 ) );
+  }
+}
+
+TEST_CASE( "IndexStats Counters Reset" ) {
+  // AAAA, AAAC, ..., AATT
+  SequenceList< DNA > sequences;
+  for( size_t i = 0; i < 16; i++ ) {
+    sequences.push_back( Sequence< DNA >(
+      std::string( "AA" ) + "ACGT"[ i / 4 ] + "ACGT"[ i % 4 ] ) );
+  }
+
+  Database< DNA > db( 4 );
+  db.Initialize( sequences );
+
+  IndexStats< DNA > stats( db );
+
+  // Query 1 touches one sequence (reset alone), query 2 three of them
+  // (AAAA, AAAC, AACA): more than an eighth, all are reset
+  stats.MeasureCountingCost(
+    { Sequence< DNA >( "AAAA" ), Sequence< DNA >( "AAAACAAG" ) } );
+  REQUIRE( stats.meanCountersReset == Approx( ( 1.0 + 16.0 ) / 2.0 ) );
+}
@@ -46,4 +46,48 @@ TEST_CASE( "Kmers" ) {
     REQUIRE( out[ 3 ] == AmbiguousKmer );
     REQUIRE( out[ 4 ] == Kmerify( "TTA" ) );
   }
+
+  SECTION( "Spaced seed" ) {
+    seq = "ACGTTGCA";
+    Kmers< DNA > k( seq, SeedMask( "1101" ) );
+    k.ForEach( [&]( Kmer kmer, size_t ) { out.push_back( kmer ); } );
+
+    REQUIRE( out.size() == 5 );
+    REQUIRE( out[ 0 ] == Kmerify( "ACT" ) );
+    REQUIRE( out[ 1 ] == Kmerify( "CGT" ) );
+    REQUIRE( out[ 4 ] == Kmerify( "TGA" ) );
+
+    // Ambiguity only matters at positions which are part of the seed
+    seq = "ACNTTGCA";
+    Kmers< DNA > k2( seq, SeedMask( "1101" ) );
+    out.clear();
+    k2.ForEach( [&]( Kmer kmer, size_t ) { out.push_back( kmer ); } );
+
+    REQUIRE( out[ 0 ] == Kmerify( "ACT" ) );
+    REQUIRE( out[ 1 ] == AmbiguousKmer );
+    REQUIRE( out[ 2 ] == AmbiguousKmer );
+    REQUIRE( out[ 3 ] == Kmerify( "TTC" ) );
+  }
+
+  SECTION( "Reverse complement" ) {
+    REQUIRE( KmerComplementPolicy< DNA >::ReverseComplement(
+               Kmerify( "ACCG" ), 4 ) == Kmerify( "CGGT" ) );
+    REQUIRE( KmerComplementPolicy< DNA >::ReverseComplement(
+               Kmerify( "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAC" ), 31 ) ==
+             Kmerify( "GTTTTTTTTTTTTTTTTTTTTTTTTTTTTTT" ) );
+
+    bool isReverse;
+    // Smaller packed value (first base in the lowest bits)
+    REQUIRE( CanonicalKmer< DNA >( Kmerify( "ACCG" ), 4, &isReverse ) ==
+             Kmerify( "CGGT" ) );
+    REQUIRE( isReverse );
+    REQUIRE( CanonicalKmer< DNA >( Kmerify( "CGGT" ), 4, &isReverse ) ==
+             Kmerify( "CGGT" ) );
+    REQUIRE( !isReverse );
+  }
+
+  SECTION( "To string" ) {
+    REQUIRE( KmerToString< DNA >( Kmerify( "ACGT" ), 4 ) == "ACGT" );
+    REQUIRE( KmerToString< DNA >( Kmerify( "GATTACA" ), 7 ) == "GATTACA" );
+  }
 }
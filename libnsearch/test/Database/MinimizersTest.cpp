@@ -0,0 +1,69 @@
+#include <catch.hpp>
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Database/Minimizers.h>
+
+#include <vector>
+
+TEST_CASE( "Minimizers" ) {
+  Sequence< DNA > seq = "ACGTTGCATGCAGGATTACAGATTACANNNNNNGATTACAGGCATCAGG";
+
+  std::vector< Kmer >   all;
+  std::vector< size_t > positions;
+  Kmers< DNA >( seq, 4 ).ForEach(
+    [&]( Kmer kmer, size_t ) { all.push_back( kmer ); } );
+
+  SECTION( "Window of one keeps every kmer" ) {
+    std::vector< Kmer > out;
+    Minimizers< DNA >( seq, SeedMask( 4 ), 1 )
+      .ForEach( [&]( Kmer kmer, size_t ) { out.push_back( kmer ); } );
+    REQUIRE( out == all );
+  }
+
+  SECTION( "Every window is covered" ) {
+    const size_t window = 5;
+    Minimizers< DNA >( seq, SeedMask( 4 ), window )
+      .ForEach( [&]( Kmer kmer, size_t pos ) {
+        REQUIRE( kmer == all[ pos ] );
+        REQUIRE( kmer != AmbiguousKmer );
+        positions.push_back( pos );
+      } );
+
+    REQUIRE( positions.size() < all.size() );
+    for( size_t i = 1; i < positions.size(); i++ ) {
+      REQUIRE( positions[ i ] > positions[ i - 1 ] );
+    }
+
+    // Each window with an unambiguous kmer has one of the minimizers
+    for( size_t start = 0; start + window <= all.size(); start++ ) {
+      bool hasValid = false, hasMinimizer = false;
+      for( size_t pos = start; pos < start + window; pos++ ) {
+        hasValid |= all[ pos ] != AmbiguousKmer;
+        hasMinimizer |= std::find( positions.begin(), positions.end(), pos ) !=
+                        positions.end();
+      }
+      REQUIRE( hasValid == hasMinimizer );
+    }
+  }
+
+  SECTION( "Same kmers in the same context" ) {
+    // GATTACA shows up in three places
+    Sequence< DNA > other = "GATTACA";
+    std::vector< Kmer > a, b;
+    Minimizers< DNA >( other, SeedMask( 4 ), 4 )
+      .ForEach( [&]( Kmer kmer, size_t ) { a.push_back( kmer ); } );
+    REQUIRE( a.size() == 1 );
+
+    Minimizers< DNA >( seq, SeedMask( 4 ), 4 )
+      .ForEach( [&]( Kmer kmer, size_t ) { b.push_back( kmer ); } );
+    REQUIRE( std::find( b.begin(), b.end(), a[ 0 ] ) != b.end() );
+  }
+
+  SECTION( "Window exceeds sequence" ) {
+    Sequence< DNA > shortSeq = "ACGTTG";
+    std::vector< Kmer > out;
+    Minimizers< DNA >( shortSeq, SeedMask( 4 ), 10 )
+      .ForEach( [&]( Kmer kmer, size_t ) { out.push_back( kmer ); } );
+    REQUIRE( out.size() == 1 );
+  }
+}
@@ -0,0 +1,47 @@
+#include <catch.hpp>
+
+#include <nsearch/Database/OffsetTable.h>
+
+TEST_CASE( "OffsetTable" ) {
+  OffsetTable table;
+  REQUIRE( table.NumEntries() == 0 );
+
+  SECTION( "Narrow" ) {
+    table.Reset( 3, 10 );
+    table.Set( 0, 0 );
+    table.Set( 1, 4 );
+    table.Set( 2, 4 );
+    table.Set( 3, 10 );
+
+    REQUIRE( !table.IsWide() );
+    REQUIRE( table.NumEntries() == 3 );
+    REQUIRE( table.Narrow().size() == 4 );
+    REQUIRE( table.Wide().empty() );
+
+    REQUIRE( table.Begin( 0 ) == 0 );
+    REQUIRE( table.Count( 0 ) == 4 );
+    REQUIRE( table.Count( 1 ) == 0 );
+    REQUIRE( table.Begin( 2 ) == 4 );
+    REQUIRE( table.End( 2 ) == 10 );
+
+    REQUIRE( table.IsValid( 10 ) );
+    REQUIRE( !table.IsValid( 9 ) );
+
+    table.Set( 1, 11 );
+    REQUIRE( !table.IsValid( 20 ) );
+  }
+
+  SECTION( "Wide" ) {
+    const size_t big = size_t( 1 ) << 33;
+    table.Reset( 2, big );
+    table.Set( 0, 0 );
+    table.Set( 1, big - 1 );
+    table.Set( 2, big );
+
+    REQUIRE( table.IsWide() );
+    REQUIRE( table.NumEntries() == 2 );
+    REQUIRE( table.Narrow().empty() );
+    REQUIRE( table.Count( 0 ) == big - 1 );
+    REQUIRE( table.Count( 1 ) == 1 );
+  }
+}
@@ -0,0 +1,80 @@
+#include <catch.hpp>
+
+#include <nsearch/Database/PostingListCodec.h>
+
+#include <vector>
+
+static std::vector< uint32_t > RoundTrip( const std::vector< uint32_t >& ids,
+                                          size_t* encodedSize = NULL ) {
+  size_t size = PostingListCodec::EncodedSize( ids.data(), ids.size() );
+  std::vector< uint8_t > encoded( size + PostingListCodec::Padding );
+  REQUIRE( PostingListCodec::Encode( ids.data(), ids.size(),
+                                     encoded.data() ) == size );
+
+  REQUIRE( PostingListCodec::NumIds( encoded.data() ) == ids.size() );
+
+  std::vector< uint32_t > decoded( ids.size() );
+  REQUIRE( PostingListCodec::Decode( encoded.data(), decoded.data() ) ==
+           ids.size() );
+
+  if( encodedSize )
+    *encodedSize = size;
+  return decoded;
+}
+
+TEST_CASE( "PostingListCodec" ) {
+  SECTION( "Empty" ) {
+    size_t size;
+    REQUIRE( RoundTrip( {}, &size ).empty() );
+    REQUIRE( size == 1 ); // count only
+  }
+
+  SECTION( "Small" ) {
+    std::vector< uint32_t > ids = { 0, 1, 5, 6, 1000, 0xFFFFFFFF };
+    REQUIRE( RoundTrip( ids ) == ids );
+  }
+
+  SECTION( "Consecutive ids need no bits" ) {
+    std::vector< uint32_t > ids;
+    for( uint32_t i = 0; i < 1000; i++ )
+      ids.push_back( i );
+
+    size_t size;
+    REQUIRE( RoundTrip( ids, &size ) == ids );
+    REQUIRE( size == 2 + 8 ); // count and one width byte per block
+  }
+
+  SECTION( "Multiple blocks" ) {
+    std::vector< uint32_t > ids;
+    uint32_t                id = 3;
+    for( uint32_t i = 0; i < 1000; i++ ) {
+      ids.push_back( id );
+      id += 1 + ( i * 7919 ) % ( i < 500 ? 13 : 100000 );
+    }
+
+    size_t size;
+    REQUIRE( RoundTrip( ids, &size ) == ids );
+    REQUIRE( size < ids.size() * sizeof( uint32_t ) );
+  }
+
+  SECTION( "Validation" ) {
+    std::vector< uint32_t > ids;
+    for( uint32_t i = 0; i < 300; i++ )
+      ids.push_back( i * 3 );
+
+    size_t size = PostingListCodec::EncodedSize( ids.data(), ids.size() );
+    std::vector< uint8_t > encoded( size + PostingListCodec::Padding );
+    PostingListCodec::Encode( ids.data(), ids.size(), encoded.data() );
+
+    REQUIRE( PostingListCodec::IsValid( encoded.data(), size, 898 ) );
+    REQUIRE( !PostingListCodec::IsValid( encoded.data(), size, 897 ) );
+    REQUIRE( !PostingListCodec::IsValid( encoded.data(), size - 1, 898 ) );
+
+    // Count, then the bit width of the first block
+    encoded[ 2 ] = 33;
+    REQUIRE( !PostingListCodec::IsValid( encoded.data(), size, 898 ) );
+
+    std::vector< uint8_t > endless( 16, 0xFF );
+    REQUIRE( !PostingListCodec::IsValid( endless.data(), 8, 1000 ) );
+  }
+}
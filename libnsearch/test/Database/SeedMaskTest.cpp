@@ -0,0 +1,38 @@
+#include <catch.hpp>
+
+#include <nsearch/Database/SeedMask.h>
+
+TEST_CASE( "SeedMask" ) {
+  SECTION( "Contiguous" ) {
+    SeedMask seed( 8 );
+    REQUIRE( seed.Span() == 8 );
+    REQUIRE( seed.Weight() == 8 );
+    REQUIRE( seed.IsContiguous() );
+    REQUIRE( seed.ToString() == "11111111" );
+  }
+
+  SECTION( "Spaced" ) {
+    SeedMask seed( "11011011" );
+    REQUIRE( seed.Span() == 8 );
+    REQUIRE( seed.Weight() == 6 );
+    REQUIRE( !seed.IsContiguous() );
+    REQUIRE( seed.CareBits() == 0b11011011 );
+    REQUIRE( SeedMask( seed.CareBits(), seed.Span() ).ToString() == "11011011" );
+  }
+
+  SECTION( "Validation" ) {
+    REQUIRE( SeedMask::IsValid( "1" ) );
+    REQUIRE( SeedMask::IsValid( "1001" ) );
+    REQUIRE( !SeedMask::IsValid( "" ) );
+    REQUIRE( !SeedMask::IsValid( "0110" ) );
+    REQUIRE( !SeedMask::IsValid( "1x1" ) );
+    REQUIRE( SeedMask( "0110" ).Span() == 0 );
+  }
+
+  SECTION( "Symmetry" ) {
+    REQUIRE( SeedMask( 8 ).IsSymmetric() );
+    REQUIRE( SeedMask( "11011011" ).IsSymmetric() );
+    REQUIRE( SeedMask( "101" ).IsSymmetric() );
+    REQUIRE( !SeedMask( "1101" ).IsSymmetric() );
+  }
+}
@@ -0,0 +1,48 @@
+#include <catch.hpp>
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Alphabet/Protein.h>
+#include <nsearch/Database/SequenceStore.h>
+
+TEST_CASE( "SequenceStore" ) {
+  SECTION( "DNA" ) {
+    SequenceList< DNA > sequences = {
+      Sequence< DNA >( "first", "ACGTTGCA" ),
+      Sequence< DNA >( "", "" ),
+      Sequence< DNA >( "third", "NACGURYACGTACGTACGTACGTACGTACGTACGTACGTN" ),
+      Sequence< DNA >( "fourth", "GGGGCCCCAAAATTTT" ),
+    };
+
+    SequenceStore< DNA > store;
+    store.Initialize( sequences );
+    REQUIRE( store.NumSequences() == 4 );
+
+    Sequence< DNA > seq;
+    for( size_t seqId = 0; seqId < sequences.size(); seqId++ ) {
+      store.Get( seqId, &seq );
+      REQUIRE( seq.identifier == sequences[ seqId ].identifier );
+      REQUIRE( seq.sequence == sequences[ seqId ].sequence );
+      REQUIRE( store.Length( seqId ) == sequences[ seqId ].Length() );
+
+      for( size_t pos = 0; pos < sequences[ seqId ].Length(); pos++ ) {
+        REQUIRE( store.Residue( seqId, pos ) == sequences[ seqId ][ pos ] );
+      }
+    }
+  }
+
+  SECTION( "Protein" ) {
+    SequenceList< Protein > sequences = {
+      Sequence< Protein >( "p1", "MKVLAXWY" ),
+      Sequence< Protein >( "p2", "GHIKLMNPQRST" ),
+    };
+
+    SequenceStore< Protein > store;
+    store.Initialize( sequences );
+
+    Sequence< Protein > seq;
+    store.Get( 1, &seq );
+    REQUIRE( seq.identifier == "p2" );
+    REQUIRE( seq.sequence == "GHIKLMNPQRST" );
+    REQUIRE( store.Residue( 0, 5 ) == 'X' );
+  }
+}
@@ -2,9 +2,15 @@
 
 #include <nsearch/Database.h>
 #include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Alphabet/Protein.h>
 
 #include "Support.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+
 TEST_CASE( "Database" ) {
   SequenceList< DNA > sequences = { "ATGGG", "CATGGCCC", "GAGAGA", "CTTTN" };
   Database< DNA > db( 4 );
@@ -53,25 +59,875 @@ TEST_CASE( "Database" ) {
   }
 
   SECTION( "Kmers for each sequence" ) {
-    const Kmer *kmers;
-    size_t numKmers;
+    std::vector< Kmer > kmers;
     bool found;
 
-    found = db.GetKmersForSequenceId( 10, &kmers, &numKmers );
+    found = db.GetKmersForSequenceId( 10, &kmers );
     REQUIRE( found == false );
 
-    found = db.GetKmersForSequenceId( 0, &kmers, &numKmers );
+    found = db.GetKmersForSequenceId( 0, &kmers );
     REQUIRE( found == true );
-    REQUIRE( numKmers == 2 );
+    REQUIRE( kmers.size() == 2 );
     REQUIRE( kmers[ 0 ] == Kmerify( "ATGG" ) );
     REQUIRE( kmers[ 1 ] == Kmerify( "TGGG" ) );
 
     SECTION( "Ambiguous nucleotide handling" ) {
-      found = db.GetKmersForSequenceId( 3, &kmers, &numKmers );
+      found = db.GetKmersForSequenceId( 3, &kmers );
       REQUIRE( found == true );
-      REQUIRE( numKmers == 2 );
+      REQUIRE( kmers.size() == 2 );
       REQUIRE( kmers[ 0 ] == Kmerify( "CTTT" ) );
       REQUIRE( kmers[ 1 ] == AmbiguousKmer );
     }
   }
 }
+
+TEST_CASE( "Database Compressed Postings" ) {
+  SequenceList< DNA > sequences = { "ATGGG", "CATGGCCC", "GAGAGA", "CTTTN" };
+
+  DatabaseParams params;
+  params.compressPostings = true;
+
+  Database< DNA > db( 4, params );
+  db.Initialize( sequences );
+
+  SequenceIdBuffer  buffer;
+  const SequenceId* seqIds;
+  size_t            numSeqIds;
+  bool              found;
+
+  found = db.GetSequenceIdsIncludingKmer( Kmerify( "TATA" ), &seqIds,
+                                          &numSeqIds, &buffer );
+  REQUIRE( found == false );
+  REQUIRE( numSeqIds == 0 );
+
+  found = db.GetSequenceIdsIncludingKmer( Kmerify( "ATGG" ), &seqIds,
+                                          &numSeqIds, &buffer );
+  REQUIRE( found == true );
+  REQUIRE( numSeqIds == 2 );
+  REQUIRE( seqIds[ 0 ] == 0 );
+  REQUIRE( seqIds[ 1 ] == 1 );
+
+  found = db.GetSequenceIdsIncludingKmer( Kmerify( "GAGA" ), &seqIds,
+                                          &numSeqIds, &buffer );
+  REQUIRE( found == true );
+  REQUIRE( numSeqIds == 1 );
+  REQUIRE( seqIds[ 0 ] == 2 );
+}
+
+static SequenceList< DNA > RandomSequences( const size_t count ) {
+  SequenceList< DNA > sequences;
+  unsigned int        state = 42;
+  for( size_t i = 0; i < count; i++ ) {
+    std::string seq;
+    for( size_t j = 0; j < 20 + i % 50; j++ ) {
+      state = state * 1103515245 + 12345;
+      seq += "ACGTN"[ ( state >> 16 ) % ( j % 17 == 0 ? 5 : 4 ) ];
+    }
+    sequences.push_back( seq );
+  }
+  return sequences;
+}
+
+TEST_CASE( "Database Multithreaded Indexing" ) {
+  // Enough sequences so the work is actually split up
+  SequenceList< DNA > sequences = RandomSequences( 2000 );
+
+  Database< DNA > serial( 4 ), parallel( 4 );
+  serial.SetNumThreads( 1 );
+  serial.Initialize( sequences );
+  parallel.SetNumThreads( 4 );
+  parallel.Initialize( sequences );
+
+  for( Kmer kmer = 0; kmer < serial.MaxUniqueKmers(); kmer++ ) {
+    const SequenceId *seqIds1, *seqIds2;
+    size_t            num1 = 0, num2 = 0;
+    serial.GetSequenceIdsIncludingKmer( kmer, &seqIds1, &num1 );
+    parallel.GetSequenceIdsIncludingKmer( kmer, &seqIds2, &num2 );
+    REQUIRE( num1 == num2 );
+    REQUIRE( std::equal( seqIds1, seqIds1 + num1, seqIds2 ) );
+  }
+}
+
+TEST_CASE( "Database Initialize Taking Over Sequences" ) {
+  SequenceList< DNA > sequences = RandomSequences( 500 );
+  SequenceList< DNA > copy      = sequences;
+
+  Database< DNA > db( 4 ), moved( 4 );
+  db.Initialize( sequences );
+  moved.Initialize( std::move( copy ) );
+
+  REQUIRE( copy.empty() );
+  REQUIRE( moved.NumSequences() == 500 );
+  REQUIRE( moved.GetSequenceById( 123 ) == sequences[ 123 ] );
+
+  for( Kmer kmer = 0; kmer < db.MaxUniqueKmers(); kmer++ ) {
+    const SequenceId *seqIds1, *seqIds2;
+    size_t            num1 = 0, num2 = 0;
+    db.GetSequenceIdsIncludingKmer( kmer, &seqIds1, &num1 );
+    moved.GetSequenceIdsIncludingKmer( kmer, &seqIds2, &num2 );
+    REQUIRE( num1 == num2 );
+    REQUIRE( std::equal( seqIds1, seqIds1 + num1, seqIds2 ) );
+  }
+}
+
+TEST_CASE( "Database Sorted Index" ) {
+  SequenceList< DNA > sequences = RandomSequences( 2000 );
+  sequences.push_back( "ACGTACGTACGTACGTACGTACGTACGTACGTACGT" );
+
+  const size_t    kmerLength = 20;
+  Database< DNA > serial( kmerLength ), parallel( kmerLength );
+  REQUIRE( !serial.IsDirectIndex() );
+  serial.SetNumThreads( 1 );
+  serial.Initialize( sequences );
+  parallel.SetNumThreads( 4 );
+  parallel.Initialize( sequences );
+
+  REQUIRE( serial.MaxUniqueKmers() == ( size_t( 1 ) << 40 ) );
+
+  // Every kmer of every sequence must be found, postings sorted and unique
+  std::vector< Kmer > kmers;
+  for( SequenceId seqId = 0; seqId < sequences.size(); seqId += 7 ) {
+    serial.GetKmersForSequenceId( seqId, &kmers );
+    for( auto kmer : kmers ) {
+      if( kmer == AmbiguousKmer )
+        continue;
+
+      const SequenceId *seqIds1, *seqIds2;
+      size_t            num1 = 0, num2 = 0;
+      REQUIRE( serial.GetSequenceIdsIncludingKmer( kmer, &seqIds1, &num1 ) );
+      REQUIRE( parallel.GetSequenceIdsIncludingKmer( kmer, &seqIds2, &num2 ) );
+      REQUIRE( num1 == num2 );
+      REQUIRE( std::equal( seqIds1, seqIds1 + num1, seqIds2 ) );
+      REQUIRE( std::find( seqIds1, seqIds1 + num1, seqId ) != seqIds1 + num1 );
+      REQUIRE( std::adjacent_find( seqIds1, seqIds1 + num1,
+                                   std::greater_equal< SequenceId >() ) ==
+               seqIds1 + num1 );
+    }
+  }
+
+  const SequenceId* seqIds;
+  size_t            numSeqIds;
+  REQUIRE( serial.GetSequenceIdsIncludingKmer(
+    Kmerify( "CGTACGTACGTACGTACGTA" ), &seqIds, &numSeqIds ) );
+  REQUIRE( numSeqIds == 1 );
+  REQUIRE( seqIds[ 0 ] == 2000 );
+
+  REQUIRE( !serial.GetSequenceIdsIncludingKmer(
+    Kmerify( "TTTTTTTTTTTTTTTTTTTT" ), &seqIds, &numSeqIds ) );
+  REQUIRE( !serial.GetSequenceIdsIncludingKmer( AmbiguousKmer, &seqIds,
+                                                &numSeqIds ) );
+}
+
+TEST_CASE( "Database Spaced Seed" ) {
+  SequenceList< DNA > sequences = { "ACGTTGCA", "AACTTT", "ACTT" };
+
+  DatabaseParams params;
+  params.seedMask = "1101";
+
+  Database< DNA > db( 8, params );
+  db.Initialize( sequences );
+  REQUIRE( db.KmerLength() == 3 );
+  REQUIRE( db.Seed().ToString() == "1101" );
+
+  // ACGT, AACT and ACTT all match the seed A C _ T
+  auto check = [&]( const Database< DNA >& db ) {
+    const SequenceId* seqIds;
+    size_t            numSeqIds;
+    REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "ACT" ), &seqIds,
+                                             &numSeqIds ) );
+    REQUIRE( numSeqIds == 3 );
+    REQUIRE( seqIds[ 2 ] == 2 );
+  };
+  check( db );
+
+  std::string path = "DatabaseSpacedSeedTest.nsx";
+  REQUIRE( db.Save( path ) );
+
+  Database< DNA > loaded( 8 );
+  REQUIRE( loaded.Load( path ) );
+  REQUIRE( loaded.Seed().ToString() == "1101" );
+  check( loaded );
+
+  remove( path.c_str() );
+}
+
+TEST_CASE( "Database Canonical Kmers" ) {
+  // Second sequence has ACCG and its reverse complement (CGGT)
+  SequenceList< DNA > sequences = { "TACCGA", "ACCGNCGGT", "GGTAC" };
+
+  DatabaseParams params;
+  params.canonicalKmers = true;
+
+  auto check = [&]( const Database< DNA >& db ) {
+    const SequenceId* seqIds;
+    size_t            numSeqIds;
+    // CGGT is the canonical kmer (smaller packed value)
+    REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "CGGT" ), &seqIds,
+                                             &numSeqIds ) );
+    REQUIRE( numSeqIds == 3 );
+    REQUIRE( seqIds[ 0 ] == ( 0 << 1 | 1 ) );
+    REQUIRE( seqIds[ 1 ] == ( 1 << 1 ) );
+    REQUIRE( seqIds[ 2 ] == ( 1 << 1 | 1 ) );
+
+    // Only looked up by canonical kmer
+    REQUIRE( !db.GetSequenceIdsIncludingKmer( Kmerify( "ACCG" ), &seqIds,
+                                              &numSeqIds ) );
+
+    // GTAC is its own reverse complement
+    REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "GTAC" ), &seqIds,
+                                             &numSeqIds ) );
+    REQUIRE( numSeqIds == 1 );
+    REQUIRE( seqIds[ 0 ] == ( 2 << 1 ) );
+  };
+
+  SECTION( "Direct index" ) {
+    Database< DNA > db( 4, params );
+    db.Initialize( sequences );
+    check( db );
+
+    std::string path = "DatabaseCanonicalTest.nsx";
+    REQUIRE( db.Save( path ) );
+
+    Database< DNA > loaded( 8 );
+    REQUIRE( loaded.Load( path ) );
+    REQUIRE( loaded.Params().canonicalKmers );
+    check( loaded );
+
+    remove( path.c_str() );
+  }
+
+  SECTION( "Sorted index" ) {
+    SequenceList< DNA > longer = RandomSequences( 500 );
+    Database< DNA >     db( 16, params ), plain( 16 );
+    REQUIRE( !db.IsDirectIndex() );
+    db.Initialize( longer );
+    plain.Initialize( longer );
+
+    // Each posting of the plain index is found under its canonical kmer
+    std::vector< Kmer > kmers;
+    for( SequenceId seqId = 0; seqId < longer.size(); seqId += 11 ) {
+      plain.GetKmersForSequenceId( seqId, &kmers );
+      for( auto kmer : kmers ) {
+        if( kmer == AmbiguousKmer )
+          continue;
+
+        bool isReverse;
+        Kmer key = CanonicalKmer< DNA >( kmer, 16, &isReverse );
+
+        const SequenceId* seqIds;
+        size_t            numSeqIds;
+        REQUIRE( db.GetSequenceIdsIncludingKmer( key, &seqIds, &numSeqIds ) );
+        SequenceId posting = ( seqId << 1 ) | ( isReverse ? 1 : 0 );
+        REQUIRE( std::binary_search( seqIds, seqIds + numSeqIds, posting ) );
+      }
+    }
+  }
+}
+
+TEST_CASE( "Database Minimizers" ) {
+  SequenceList< DNA > sequences = RandomSequences( 500 );
+
+  DatabaseParams params;
+  params.minimizerWindow = 8;
+
+  Database< DNA > db( 8, params ), plain( 8 );
+  db.Initialize( sequences );
+  plain.Initialize( sequences );
+
+  // Only the minimizers are indexed, and they are found
+  size_t numPostings = 0, numPlainPostings = 0;
+  for( Kmer kmer = 0; kmer < db.MaxUniqueKmers(); kmer++ ) {
+    const SequenceId* seqIds;
+    size_t            num = 0;
+    db.GetSequenceIdsIncludingKmer( kmer, &seqIds, &num );
+    numPostings += num;
+    plain.GetSequenceIdsIncludingKmer( kmer, &seqIds, &num );
+    numPlainPostings += num;
+  }
+  REQUIRE( numPostings * 2 < numPlainPostings );
+
+  for( SequenceId seqId = 0; seqId < sequences.size(); seqId += 13 ) {
+    db.ForEachIndexedKmer( sequences[ seqId ], [&]( Kmer kmer, size_t ) {
+      const SequenceId* seqIds;
+      size_t            num = 0;
+      REQUIRE( db.GetSequenceIdsIncludingKmer( kmer, &seqIds, &num ) );
+      REQUIRE( std::binary_search( seqIds, seqIds + num, seqId ) );
+    } );
+  }
+
+  std::string path = "DatabaseMinimizersTest.nsx";
+  REQUIRE( db.Save( path ) );
+
+  Database< DNA > loaded( 8 );
+  REQUIRE( loaded.Load( path ) );
+  REQUIRE( loaded.Params().minimizerWindow == 8 );
+
+  remove( path.c_str() );
+}
+
+TEST_CASE( "Database Stoplist" ) {
+  // ACGT is in every sequence, GGGG in one
+  SequenceList< DNA > sequences = { "ACGTGGGG", "TTACGT", "ACGTCC", "CACGTA" };
+
+  DatabaseParams params;
+  params.maxKmerFrequency = 0.5;
+
+  SECTION( "Plain" ) {}
+  SECTION( "Compressed" ) {
+    params.compressPostings = true;
+  }
+
+  Database< DNA > db( 4, params );
+  db.Initialize( sequences );
+
+  REQUIRE( db.NumStopKmers() == 1 );
+  REQUIRE( db.IsStopKmer( Kmerify( "ACGT" ) ) );
+  REQUIRE( !db.IsStopKmer( Kmerify( "GGGG" ) ) );
+
+  auto check = [&]( const Database< DNA >& db ) {
+    SequenceIdBuffer  buffer;
+    const SequenceId* seqIds;
+    size_t            numSeqIds;
+    REQUIRE( !db.GetSequenceIdsIncludingKmer( Kmerify( "ACGT" ), &seqIds,
+                                              &numSeqIds, &buffer ) );
+    REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "GGGG" ), &seqIds,
+                                             &numSeqIds, &buffer ) );
+    REQUIRE( numSeqIds == 1 );
+    REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "CGTC" ), &seqIds,
+                                             &numSeqIds, &buffer ) );
+    REQUIRE( seqIds[ 0 ] == 2 );
+  };
+  check( db );
+
+  std::string path = "DatabaseStoplistTest.nsx";
+  REQUIRE( db.Save( path ) );
+
+  Database< DNA > loaded( 4 );
+  REQUIRE( loaded.Load( path ) );
+  REQUIRE( loaded.Params().maxKmerFrequency == 0.5 );
+  REQUIRE( loaded.NumStopKmers() == 1 );
+  check( loaded );
+
+  remove( path.c_str() );
+
+  SECTION( "Sorted index" ) {
+    Database< DNA > sorted( 13, params );
+    sequences = { "ACGTACGTACGTAC", "ACGTACGTACGTA", "TTTTTTTTTTTTT" };
+    sorted.Initialize( sequences );
+    REQUIRE( sorted.NumStopKmers() == 1 );
+    REQUIRE( sorted.IsStopKmer( Kmerify( "ACGTACGTACGTA" ) ) );
+
+    SequenceIdBuffer  buffer;
+    const SequenceId* seqIds;
+    size_t            numSeqIds;
+    REQUIRE( sorted.GetSequenceIdsIncludingKmer(
+      Kmerify( "CGTACGTACGTAC" ), &seqIds, &numSeqIds, &buffer ) );
+    REQUIRE( seqIds[ 0 ] == 0 );
+  }
+}
+
+TEST_CASE( "Database Low-Complexity Masking" ) {
+  SequenceList< DNA > sequences = {
+    "TGCATGACGCTAGCTTAGCAATCGGATATATATATATATATATATATATATATATATAT",
+    "TTGACCATATGTAC" };
+
+  DatabaseParams params;
+  params.dustMask = true;
+
+  Database< DNA > db( 4, params );
+  db.Initialize( sequences );
+
+  MaskedRegions regions;
+  db.GetMaskedRegions( sequences[ 0 ], &regions );
+  REQUIRE( regions.size() == 1 );
+
+  const SequenceId* seqIds;
+  size_t            numSeqIds;
+  REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "ATAT" ), &seqIds,
+                                           &numSeqIds ) );
+  REQUIRE( numSeqIds == 1 );
+  REQUIRE( seqIds[ 0 ] == 1 );
+
+  REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "TGCA" ), &seqIds,
+                                           &numSeqIds ) );
+  REQUIRE( seqIds[ 0 ] == 0 );
+
+  std::string path = "DatabaseDustTest.nsx";
+  REQUIRE( db.Save( path ) );
+  Database< DNA > loaded( 4 );
+  REQUIRE( loaded.Load( path ) );
+  REQUIRE( loaded.Params().dustMask );
+  remove( path.c_str() );
+}
+
+TEST_CASE( "Database Append" ) {
+  SequenceList< DNA > sequences = RandomSequences( 400 );
+  SequenceList< DNA > first( sequences.begin(), sequences.begin() + 350 );
+  SequenceList< DNA > second( sequences.begin() + 350, sequences.begin() + 370 );
+  SequenceList< DNA > third( sequences.begin() + 370, sequences.end() );
+
+  DatabaseParams params;
+  SECTION( "Plain" ) {}
+  SECTION( "Compressed" ) {
+    params.compressPostings = true;
+  }
+  SECTION( "Canonical" ) {
+    params.canonicalKmers = true;
+  }
+
+  Database< DNA > full( 6, params ), db( 6, params );
+  full.Initialize( sequences );
+  db.Initialize( first );
+  db.Append( second );
+  db.Append( third );
+
+  REQUIRE( db.NumAppendedSequences() == 50 );
+  REQUIRE( db.NumSequences() == 400 );
+  REQUIRE( db.GetSequenceById( 375 ) == sequences[ 375 ] );
+  REQUIRE( db.GetSequenceById( 10 ) == sequences[ 10 ] );
+
+  auto check = [&]() {
+    SequenceIdBuffer buffer1, buffer2;
+    for( Kmer kmer = 0; kmer < full.MaxUniqueKmers(); kmer++ ) {
+      const SequenceId *seqIds1, *seqIds2;
+      size_t            num1 = 0, num2 = 0;
+      full.GetSequenceIdsIncludingKmer( kmer, &seqIds1, &num1, &buffer1 );
+      db.GetSequenceIdsIncludingKmer( kmer, &seqIds2, &num2, &buffer2 );
+      REQUIRE( num1 == num2 );
+      REQUIRE( std::equal( seqIds1, seqIds1 + num1, seqIds2 ) );
+    }
+  };
+
+  // Delta segment is searched alongside
+  check();
+
+  std::string path = "DatabaseAppendTest.nsx";
+  REQUIRE( db.Save( path ) );
+  Database< DNA > loaded( 6 );
+  REQUIRE( loaded.Load( path ) );
+  REQUIRE( loaded.NumSequences() == 400 );
+  REQUIRE( loaded.NumAppendedSequences() == 0 );
+  REQUIRE( loaded.GetSequenceById( 399 ) == sequences[ 399 ] );
+  remove( path.c_str() );
+
+  db.Merge();
+  REQUIRE( db.NumAppendedSequences() == 0 );
+  REQUIRE( db.NumSequences() == 400 );
+  check();
+
+  SECTION( "Merged when the delta grows too large" ) {
+    db.Append( RandomSequences( 200 ) );
+    REQUIRE( db.NumAppendedSequences() == 0 );
+    REQUIRE( db.NumSequences() == 600 );
+  }
+}
+
+TEST_CASE( "Database Duplicates" ) {
+  SequenceList< DNA > sequences = { "ATGGGC", "CATGGCCC", "ATGGGC", "GAGAGA",
+                                    "ATGGGC", "CATGGCCC" };
+  for( size_t i = 0; i < sequences.size(); i++ ) {
+    sequences[ i ].identifier = std::to_string( i );
+  }
+
+  DatabaseParams params;
+  params.collapseDuplicates = true;
+
+  Database< DNA > db( 4, params );
+  db.Initialize( sequences );
+
+  auto check = [&]( const Database< DNA >& db ) {
+    REQUIRE( db.NumSequences() == 3 );
+    REQUIRE( db.GetSequenceById( 0 ).identifier == "0" );
+    REQUIRE( db.GetSequenceById( 1 ).identifier == "1" );
+    REQUIRE( db.GetSequenceById( 2 ).identifier == "3" );
+
+    Sequence< DNA > seq;
+    REQUIRE( db.NumDuplicates( 0 ) == 2 );
+    db.GetDuplicate( 0, 0, &seq );
+    REQUIRE( seq == sequences[ 0 ] );
+    REQUIRE( seq.identifier == "2" );
+    db.GetDuplicate( 0, 1, &seq );
+    REQUIRE( seq.identifier == "4" );
+
+    REQUIRE( db.NumDuplicates( 1 ) == 1 );
+    db.GetDuplicate( 1, 0, &seq );
+    REQUIRE( seq.identifier == "5" );
+    REQUIRE( db.NumDuplicates( 2 ) == 0 );
+
+    REQUIRE( db.OriginalSequenceId( 2 ) == 3 );
+    REQUIRE( db.OriginalDuplicateId( 0, 0 ) == 2 );
+    REQUIRE( db.OriginalDuplicateId( 0, 1 ) == 4 );
+    REQUIRE( db.OriginalDuplicateId( 1, 0 ) == 5 );
+
+    const SequenceId* seqIds;
+    size_t            numSeqIds;
+    REQUIRE( db.GetSequenceIdsIncludingKmer( Kmerify( "ATGG" ), &seqIds,
+                                             &numSeqIds ) );
+    REQUIRE( numSeqIds == 2 );
+    REQUIRE( seqIds[ 0 ] == 0 );
+    REQUIRE( seqIds[ 1 ] == 1 );
+  };
+
+  check( db );
+
+  SECTION( "Save and load" ) {
+    std::string path = "DatabaseDuplicatesTest.nsx";
+    REQUIRE( db.Save( path ) );
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path ) );
+    REQUIRE( loaded.Params().collapseDuplicates );
+    check( loaded );
+    remove( path.c_str() );
+  }
+
+  SECTION( "Append" ) {
+    SequenceList< DNA > more = { "TTTTAAAA", "GAGAGA" };
+    more[ 1 ].identifier     = "appended";
+    db.Append( more );
+    REQUIRE( db.NumSequences() == 4 );
+
+    db.Merge();
+    REQUIRE( db.NumSequences() == 4 );
+    REQUIRE( db.NumDuplicates( 0 ) == 2 );
+    REQUIRE( db.NumDuplicates( 1 ) == 1 );
+
+    Sequence< DNA > seq;
+    REQUIRE( db.NumDuplicates( 2 ) == 1 );
+    db.GetDuplicate( 2, 0, &seq );
+    REQUIRE( seq.identifier == "appended" );
+
+    // Merged sequences keep their position in the input, so merging
+    // again (or rebuilding from scratch) stores them the same way
+    SequenceList< DNA > all = sequences;
+    all.insert( all.end(), more.begin(), more.end() );
+    for( SequenceId seqId = 0; seqId < db.NumSequences(); seqId++ ) {
+      seq = db.GetSequenceById( seqId );
+      REQUIRE( seq == all[ db.OriginalSequenceId( seqId ) ] );
+      REQUIRE( seq.identifier ==
+               all[ db.OriginalSequenceId( seqId ) ].identifier );
+      for( size_t index = 0; index < db.NumDuplicates( seqId ); index++ ) {
+        db.GetDuplicate( seqId, index, &seq );
+        REQUIRE( seq.identifier ==
+                 all[ db.OriginalDuplicateId( seqId, index ) ].identifier );
+      }
+    }
+    REQUIRE( db.OriginalDuplicateId( 2, 0 ) == 7 );
+
+    db.Append( { "CCCCGGGG" } );
+    db.Merge();
+    REQUIRE( db.OriginalSequenceId( 3 ) == 6 );
+    REQUIRE( db.OriginalSequenceId( 4 ) == 8 );
+    REQUIRE( db.OriginalDuplicateId( 0, 1 ) == 4 );
+    REQUIRE( db.OriginalDuplicateId( 2, 0 ) == 7 );
+  }
+}
+
+TEST_CASE( "Database Sorted By Length" ) {
+  SequenceList< DNA > sequences = { "ATGGGCATGGCC", "CATGG", "GAGAGATT",
+                                    "TTTTAAAA", "ACGTACGTACGTACGT" };
+  for( size_t i = 0; i < sequences.size(); i++ ) {
+    sequences[ i ].identifier = std::to_string( i );
+  }
+
+  DatabaseParams params;
+  params.sortByLength = true;
+
+  Database< DNA > db( 4, params );
+  db.Initialize( sequences );
+
+  auto check = [&]( const Database< DNA >& db ) {
+    REQUIRE( db.NumSequences() == 5 );
+    REQUIRE( db.GetSequenceById( 0 ).identifier == "1" );
+    REQUIRE( db.GetSequenceById( 1 ).identifier == "2" );
+    REQUIRE( db.GetSequenceById( 2 ).identifier == "3" );
+    REQUIRE( db.GetSequenceById( 3 ).identifier == "0" );
+    REQUIRE( db.SequenceLength( 4 ) == 16 );
+
+    SequenceId first, last;
+    REQUIRE( db.GetSequenceIdRangeByLength( 6, 12, &first, &last ) );
+    REQUIRE( first == 1 );
+    REQUIRE( last == 4 );
+    REQUIRE( db.GetSequenceIdRangeByLength( 0, 5, &first, &last ) );
+    REQUIRE( first == 0 );
+    REQUIRE( last == 1 );
+    REQUIRE( db.GetSequenceIdRangeByLength( 20, 30, &first, &last ) );
+    REQUIRE( first == last );
+  };
+
+  check( db );
+
+  SECTION( "Save and load" ) {
+    std::string path = "DatabaseSortedByLengthTest.nsx";
+    REQUIRE( db.Save( path ) );
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path ) );
+    REQUIRE( loaded.Params().sortByLength );
+    check( loaded );
+    remove( path.c_str() );
+  }
+
+  SECTION( "Not sorted" ) {
+    Database< DNA > unsorted( 4 );
+    unsorted.Initialize( sequences );
+
+    SequenceId first, last;
+    REQUIRE( unsorted.GetSequenceIdRangeByLength( 0, 5, &first, &last ) ==
+             false );
+  }
+
+  SECTION( "Appended sequences are not in order" ) {
+    db.Append( { "ACGT" } );
+
+    SequenceId first, last;
+    REQUIRE( db.GetSequenceIdRangeByLength( 0, 5, &first, &last ) == false );
+  }
+}
+
+TEST_CASE( "Database Clustered Sequences" ) {
+  // Two families of similar sequences, interleaved
+  SequenceList< DNA > sequences;
+  const std::string   families[] = { "ATGGGCATGGCCTTAGCAATCGGAT",
+                                     "CCTGAAGTTCACGCGTATTTGACGA" };
+  for( size_t i = 0; i < 10; i++ ) {
+    std::string seq = families[ i % 2 ];
+    seq[ i + 3 ]    = seq[ i + 3 ] == 'A' ? 'C' : 'A';
+    sequences.push_back( Sequence< DNA >( std::to_string( i ), seq ) );
+  }
+
+  DatabaseParams params;
+  params.clusterSequences = true;
+
+  Database< DNA > db( 6, params );
+  db.Initialize( sequences );
+  REQUIRE( db.NumSequences() == 10 );
+
+  // Every sequence is kept, and can be traced back
+  std::vector< bool > seen( 10, false );
+  for( SequenceId seqId = 0; seqId < 10; seqId++ ) {
+    SequenceId original = db.OriginalSequenceId( seqId );
+    REQUIRE( db.GetSequenceById( seqId ) == sequences[ original ] );
+    seen[ original ] = true;
+  }
+  REQUIRE( std::count( seen.begin(), seen.end(), true ) == 10 );
+
+  // Families are no longer interleaved
+  size_t numSwitches = 0;
+  for( SequenceId seqId = 1; seqId < 10; seqId++ ) {
+    if( db.OriginalSequenceId( seqId ) % 2 !=
+        db.OriginalSequenceId( seqId - 1 ) % 2 )
+      numSwitches++;
+  }
+  REQUIRE( numSwitches < 9 );
+
+  std::string path = "DatabaseClusteredTest.nsx";
+  REQUIRE( db.Save( path ) );
+  Database< DNA > loaded( 6 );
+  REQUIRE( loaded.Load( path ) );
+  REQUIRE( loaded.Params().clusterSequences );
+  for( SequenceId seqId = 0; seqId < 10; seqId++ ) {
+    REQUIRE( loaded.OriginalSequenceId( seqId ) ==
+             db.OriginalSequenceId( seqId ) );
+  }
+  remove( path.c_str() );
+
+  SECTION( "Collapsed duplicates" ) {
+    SequenceList< DNA > withCopies = sequences;
+    withCopies.push_back( sequences[ 3 ] );
+    withCopies.push_back( sequences[ 4 ] );
+    withCopies.push_back( "ACGTTT" );
+
+    params.collapseDuplicates = true;
+    Database< DNA > collapsed( 6, params );
+    collapsed.Initialize( withCopies );
+    collapsed.Append( { "GGGGCCCC" } );
+    REQUIRE( collapsed.NumSequences() == 12 );
+
+    std::vector< SequenceId > originals;
+    for( SequenceId seqId = 0; seqId < 12; seqId++ ) {
+      originals.push_back( collapsed.OriginalSequenceId( seqId ) );
+    }
+    std::sort( originals.begin(), originals.end() );
+    REQUIRE( originals ==
+             std::vector< SequenceId >( { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 12,
+                                          13 } ) );
+
+    // Merging clusters the appended sequence in, the ids still point
+    // into the input
+    withCopies.push_back( "GGGGCCCC" );
+    collapsed.Merge();
+    REQUIRE( collapsed.NumSequences() == 12 );
+    originals.clear();
+    for( SequenceId seqId = 0; seqId < 12; seqId++ ) {
+      SequenceId original = collapsed.OriginalSequenceId( seqId );
+      REQUIRE( collapsed.GetSequenceById( seqId ) == withCopies[ original ] );
+      originals.push_back( original );
+      for( size_t index = 0; index < collapsed.NumDuplicates( seqId );
+           index++ ) {
+        originals.push_back( collapsed.OriginalDuplicateId( seqId, index ) );
+        REQUIRE( withCopies[ originals.back() ] == withCopies[ original ] );
+      }
+    }
+    std::sort( originals.begin(), originals.end() );
+    REQUIRE( originals.size() == withCopies.size() );
+    for( SequenceId id = 0; id < originals.size(); id++ ) {
+      REQUIRE( originals[ id ] == id );
+    }
+  }
+
+  SECTION( "Appended and merged" ) {
+    SequenceList< DNA > appended = { "CCTGAAGTTCACGCGTATTTGACGA",
+                                     "ACGGTCCATCCAGGTAAACTTCTGA" };
+    db.Append( appended );
+    db.Merge();
+
+    // As if all had been given to Initialize
+    SequenceList< DNA > all = sequences;
+    all.insert( all.end(), appended.begin(), appended.end() );
+    Database< DNA > rebuilt( 6, params );
+    rebuilt.Initialize( all );
+    REQUIRE( db.NumSequences() == 12 );
+    for( SequenceId seqId = 0; seqId < 12; seqId++ ) {
+      REQUIRE( db.OriginalSequenceId( seqId ) ==
+               rebuilt.OriginalSequenceId( seqId ) );
+      REQUIRE( db.GetSequenceById( seqId ) ==
+               all[ db.OriginalSequenceId( seqId ) ] );
+    }
+  }
+}
+
+TEST_CASE( "Database Memory Estimate" ) {
+  DatabaseParams params;
+  params.minimizerWindow = 8;
+
+  Database< DNA > db( 8 ), sampled( 8, params );
+
+  const size_t fixed = db.EstimateMemoryUsage( 0, 0, 0 );
+  REQUIRE( fixed >= db.MaxUniqueKmers() * sizeof( uint32_t ) );
+  REQUIRE( db.EstimateMemoryUsage( 10, 10000, 100 ) > fixed );
+  REQUIRE( db.EstimateMemoryUsage( 10, 10000, 100 ) >
+           sampled.EstimateMemoryUsage( 10, 10000, 100 ) );
+
+  // Large words are indexed in a sorted array, no fixed overhead
+  Database< DNA > large( 20 );
+  REQUIRE( large.EstimateMemoryUsage( 0, 0, 0 ) == 0 );
+}
+
+// Overwrite one element of a section of an index file (keeping the checksum)
+template < typename T >
+static void PatchSection( const std::string& path, const size_t section,
+                          const size_t index, const T value ) {
+  std::fstream file( path, std::ios::binary | std::ios::in | std::ios::out );
+
+  IndexFile::Header header;
+  file.read( ( char* ) &header, sizeof( header ) );
+
+  IndexFile::SectionEntry entry;
+  file.seekg( header.sectionTableOffset + section * sizeof( entry ) );
+  file.read( ( char* ) &entry, sizeof( entry ) );
+  REQUIRE( index < entry.count );
+  REQUIRE( entry.elementSize == sizeof( T ) );
+
+  file.seekp( entry.offset + index * sizeof( T ) );
+  file.write( ( const char* ) &value, sizeof( value ) );
+}
+
+TEST_CASE( "Database Index File" ) {
+  SequenceList< DNA > sequences = { "ATGGG", "CATGGCCC", "GAGAGA", "CTTTN" };
+  sequences[ 1 ].identifier = "second";
+
+  Database< DNA > db( 4 );
+  db.Initialize( sequences );
+
+  std::string path = "DatabaseTest.nsx";
+  REQUIRE( db.Save( path ) );
+  REQUIRE( IndexFile::Reader::IsIndexFile( path ) );
+
+  SECTION( "Load" ) {
+    Database< DNA > loaded( 8 );
+    REQUIRE( loaded.Load( path ) );
+
+    REQUIRE( loaded.KmerLength() == 4 );
+    REQUIRE( loaded.NumSequences() == 4 );
+    REQUIRE( loaded.GetSequenceById( 1 ) == Sequence< DNA >( "CATGGCCC" ) );
+    REQUIRE( loaded.GetSequenceById( 1 ).identifier == "second" );
+
+    const SequenceId* seqIds;
+    size_t            numSeqIds;
+    REQUIRE( loaded.GetSequenceIdsIncludingKmer( Kmerify( "ATGG" ), &seqIds,
+                                                 &numSeqIds ) );
+    REQUIRE( numSeqIds == 2 );
+    REQUIRE( seqIds[ 0 ] == 0 );
+    REQUIRE( seqIds[ 1 ] == 1 );
+
+    std::vector< Kmer > kmers;
+    REQUIRE( loaded.GetKmersForSequenceId( 3, &kmers ) );
+    REQUIRE( kmers.size() == 2 );
+    REQUIRE( kmers[ 1 ] == AmbiguousKmer );
+  }
+
+  SECTION( "Params" ) {
+    size_t         kmerLength;
+    DatabaseParams params;
+    REQUIRE( Database< DNA >::LoadParams( path, &kmerLength, &params ) );
+    REQUIRE( kmerLength == 4 );
+    REQUIRE( params.seedMask == "1111" );
+    REQUIRE( !params.dustMask );
+
+    REQUIRE( !Database< Protein >::LoadParams( path, &kmerLength, &params ) );
+  }
+
+  SECTION( "Alphabet mismatch" ) {
+    Database< Protein > loaded( 4 );
+    REQUIRE( loaded.Load( path ) == false );
+  }
+
+  SECTION( "Corrupt file" ) {
+    std::fstream file( path, std::ios::binary | std::ios::in | std::ios::out );
+    file.seekp( -1, std::ios::end );
+    file.put( 'X' );
+    file.close();
+
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path, true ) == false );
+  }
+
+  // Sections: parameters, sequences (identifiers, their offsets, residues,
+  // their offsets, exception indices and residues), kmers, posting offsets,
+  // postings, ...
+  SECTION( "Residue exception out of range" ) {
+    PatchSection< uint64_t >( path, 7, 0, 100 );
+
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path ) == false );
+  }
+
+  SECTION( "Decreasing posting offsets" ) {
+    PatchSection< uint32_t >( path, 10, 1, 1000 );
+
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path ) == false );
+  }
+
+  SECTION( "Posting out of range" ) {
+    PatchSection< SequenceId >( path, 12, 0, 4 );
+
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path ) == false );
+  }
+
+  SECTION( "Compressed posting out of range" ) {
+    DatabaseParams params;
+    params.compressPostings = true;
+    Database< DNA > compressed( 4, params );
+    compressed.Initialize( sequences );
+    REQUIRE( compressed.Save( path ) );
+
+    // Count of the first list, then its bit width
+    PatchSection< uint8_t >( path, 13, 1, 32 );
+
+    Database< DNA > loaded( 4 );
+    REQUIRE( loaded.Load( path ) == false );
+  }
+
+  remove( path.c_str() );
+}
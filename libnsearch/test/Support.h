@@ -14,7 +14,7 @@ static Kmer Kmerify( const std::string& a ) {
       case 'G': val = 0b11; break;
       default: val = 0b10; /// T, U
     }
-    kmer |= val << counter;
+    kmer |= Kmer( val ) << counter;
     counter += 2;
   }
   return kmer;
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Alphabet/Protein.h>
+#include <nsearch/Database.h>
+#include <nsearch/Sequence.h>
+
+#include <utility>
+
+#include "Common.h"
+#include "FileFormat.h"
+
+template < typename A >
+struct WordSize {
+  static const int VALUE = 8; // DNA, default
+};
+
+template <>
+struct WordSize< Protein > {
+  static const int VALUE = 5;
+};
+
+enum DatabaseProgressType { ReadDBFile = 100, StatsDB, IndexDB };
+
+static void AddDatabaseProgressStages( ProgressOutput* progress ) {
+  progress->Add( DatabaseProgressType::ReadDBFile, "Read database",
+                 UnitType::BYTES );
+  progress->Add( DatabaseProgressType::StatsDB, "Analyze database" );
+  progress->Add( DatabaseProgressType::IndexDB, "Index database" );
+}
+
+// Build the kmer index of sequences read before. The database takes them
+// over, so they are freed as soon as they are packed.
+template < typename A >
+void IndexDatabase( SequenceList< A >&& sequences, Database< A >* db,
+                    ProgressOutput* progress ) {
+  db->SetProgressCallback(
+    [progress]( typename Database< A >::ProgressType type, size_t num,
+                size_t total ) {
+      switch( type ) {
+        case Database< A >::ProgressType::StatsCollection:
+          progress->Activate( DatabaseProgressType::StatsDB )
+            .Set( DatabaseProgressType::StatsDB, num, total );
+          break;
+
+        case Database< A >::ProgressType::Indexing:
+          progress->Activate( DatabaseProgressType::IndexDB )
+            .Set( DatabaseProgressType::IndexDB, num, total );
+          break;
+
+        default:
+          break;
+      }
+    } );
+  db->Initialize( std::move( sequences ) );
+}
+
+// Read sequences from FASTA/FASTQ and build the kmer index
+template < typename A >
+void BuildDatabase( const std::string& databasePath, Database< A >* db,
+                    ProgressOutput* progress ) {
+  Sequence< A >     seq;
+  SequenceList< A > sequences;
+
+  auto dbReader =
+    DetectFileFormatAndOpenReader< A >( databasePath, FileFormat::FASTA );
+
+  // Read DB
+  progress->Activate( DatabaseProgressType::ReadDBFile );
+  while( !dbReader->EndOfFile() ) {
+    ( *dbReader ) >> seq;
+    sequences.push_back( std::move( seq ) );
+    progress->Set( DatabaseProgressType::ReadDBFile, dbReader->NumBytesRead(),
+                   dbReader->NumBytesTotal() );
+  }
+
+  // Index DB
+  IndexDatabase( std::move( sequences ), db, progress );
+}
+
+// Reads a database file in consecutive shards, each as large as fits into
+// maxMemory bytes once indexed (see Database::EstimateMemoryUsage).
+// A shard holds at least one sequence.
+template < typename A >
+class DatabaseShardReader {
+public:
+  DatabaseShardReader( const std::string& databasePath,
+                       const Database< A >& db, const size_t maxMemory )
+      : mReader( DetectFileFormatAndOpenReader< A >( databasePath,
+                                                     FileFormat::FASTA ) ),
+        mDB( db ), mMaxMemory( maxMemory ), mHasPending( false ) {}
+
+  bool EndOfFile() const {
+    return !mHasPending && mReader->EndOfFile();
+  }
+
+  void Read( SequenceList< A >* sequences, ProgressOutput* progress ) {
+    sequences->clear();
+
+    size_t numResidues = 0, numIdentifierChars = 0, numBytes = 0;
+
+    progress->Activate( DatabaseProgressType::ReadDBFile );
+    while( mHasPending || !mReader->EndOfFile() ) {
+      if( !mHasPending ) {
+        ( *mReader ) >> mPending;
+        mHasPending = true;
+      }
+
+      // The sequences themselves are held while indexing, too
+      size_t seqBytes = sizeof( Sequence< A > ) + mPending.Length() * 2 +
+                        mPending.identifier.size();
+      size_t estimate =
+        numBytes + seqBytes +
+        mDB.EstimateMemoryUsage(
+          sequences->size() + 1, numResidues + mPending.Length(),
+          numIdentifierChars + mPending.identifier.size() );
+      if( !sequences->empty() && estimate > mMaxMemory )
+        break;
+
+      numBytes += seqBytes;
+      numResidues += mPending.Length();
+      numIdentifierChars += mPending.identifier.size();
+      sequences->push_back( std::move( mPending ) );
+      mHasPending = false;
+
+      progress->Set( DatabaseProgressType::ReadDBFile, mReader->NumBytesRead(),
+                     mReader->NumBytesTotal() );
+    }
+  }
+
+private:
+  std::unique_ptr< SequenceReader< A > > mReader;
+  const Database< A >&                   mDB;
+  size_t                                 mMaxMemory;
+  Sequence< A >                          mPending;
+  bool                                   mHasPending;
+};
@@ -0,0 +1,38 @@
+#include "Index.h"
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Alphabet/Protein.h>
+#include <nsearch/Database.h>
+
+#include "BuildDatabase.h"
+#include "Common.h"
+
+template < typename A >
+bool DoIndex( const std::string& databasePath, const std::string& outputPath,
+              const size_t wordSize, const DatabaseParams& databaseParams ) {
+  ProgressOutput progress;
+
+  enum ProgressType { WriteIndex };
+
+  AddDatabaseProgressStages( &progress );
+  progress.Add( ProgressType::WriteIndex, "Write index" );
+
+  Database< A > db( wordSize, databaseParams );
+  BuildDatabase( databasePath, &db, &progress );
+
+  progress.Activate( ProgressType::WriteIndex );
+  if( !db.Save( outputPath ) ) {
+    std::cerr << std::endl
+              << "Could not write database index " << outputPath << std::endl;
+    return false;
+  }
+  progress.Set( ProgressType::WriteIndex, 1, 1 );
+
+  return true;
+}
+
+// Explicit instantiation
+template bool DoIndex< DNA >( const std::string&, const std::string&,
+                              const size_t, const DatabaseParams& );
+template bool DoIndex< Protein >( const std::string&, const std::string&,
+                                  const size_t, const DatabaseParams& );
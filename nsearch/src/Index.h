@@ -0,0 +1,11 @@
+#pragma once
+
+#include <nsearch/Database.h>
+
+#include <string>
+
+template < typename Alphabet >
+extern bool DoIndex( const std::string& databasePath,
+                     const std::string&    outputPath,
+                     const size_t          wordSize,
+                     const DatabaseParams& databaseParams );
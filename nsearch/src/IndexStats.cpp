@@ -0,0 +1,163 @@
+#include "IndexStats.h"
+
+#include <nsearch/Alphabet/DNA.h>
+#include <nsearch/Alphabet/Protein.h>
+#include <nsearch/Database.h>
+#include <nsearch/Database/IndexStats.h>
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "BuildDatabase.h"
+#include "Common.h"
+#include "FileFormat.h"
+
+static void PrintStatsLine( const std::string& label, const std::string& value,
+                            const std::string& note = "" ) {
+  std::cout << "  " << std::left << std::setw( 28 ) << label << std::right
+            << std::setw( 14 ) << value;
+  if( !note.empty() ) {
+    std::cout << "  " << note;
+  }
+  std::cout << std::endl;
+}
+
+static std::string Percent( const double fraction ) {
+  std::ostringstream str;
+  str << std::fixed << std::setprecision( 1 ) << fraction * 100.0 << "%";
+  return str.str();
+}
+
+static std::string Number( const double value, const int precision = 0 ) {
+  std::ostringstream str;
+  str << std::fixed << std::setprecision( precision ) << value;
+  return str.str();
+}
+
+template < typename A >
+static void PrintIndexStats( const Database< A >&   db,
+                             const IndexStats< A >& stats ) {
+  std::cout << std::endl << std::endl << "Index:" << std::endl;
+  PrintStatsLine( "Sequences", Number( stats.numSequences ) );
+  PrintStatsLine( "Residues", Number( stats.numResidues ) );
+  PrintStatsLine( "Word length", Number( db.KmerLength() ),
+                  db.IsDirectIndex() ? "direct index" : "sorted index" );
+  PrintStatsLine( "Kmers indexed", Number( stats.numKmers ) );
+  PrintStatsLine( "Postings", Number( stats.numPostings ) );
+  PrintStatsLine( "Stop kmers", Number( stats.numStopKmers ) );
+  PrintStatsLine( "Ambiguous or masked kmers",
+                  Number( stats.numAmbiguousKmers ),
+                  Percent( stats.AmbiguousKmerFraction() ) );
+
+  std::cout << std::endl << "Memory:" << std::endl;
+  for( auto& array : stats.arrays ) {
+    if( array.second == 0 )
+      continue;
+
+    PrintStatsLine( array.first,
+                    ValueWithUnit( array.second, UnitType::BYTES ),
+                    Percent( double( array.second ) / stats.totalBytes ) );
+  }
+  PrintStatsLine( "Total", ValueWithUnit( stats.totalBytes, UnitType::BYTES ) );
+
+  std::cout << std::endl << "Posting list lengths:" << std::endl;
+  for( size_t bucket = 0; bucket < stats.postingListLengths.size();
+       bucket++ ) {
+    const size_t num = stats.postingListLengths[ bucket ];
+    if( num == 0 )
+      continue;
+
+    const size_t first = size_t( 1 ) << bucket;
+    PrintStatsLine( Number( first ) + " - " + Number( 2 * first - 1 ),
+                    Number( num ), Percent( double( num ) / stats.numKmers ) );
+  }
+  PrintStatsLine( "Mean",
+                  Number( stats.numKmers > 0 ? double( stats.numPostings ) /
+                                                 stats.numKmers
+                                             : 0.0,
+                          1 ) );
+  PrintStatsLine( "Max", Number( stats.maxPostingListLength ) );
+
+  std::cout << std::endl << "Most frequent kmers:" << std::endl;
+  for( auto& kmer : stats.topKmers ) {
+    PrintStatsLine( KmerToString< A >( kmer.first, db.KmerLength() ),
+                    Number( kmer.second ),
+                    Percent( double( kmer.second ) /
+                             std::max< size_t >( 1, stats.numSequences ) ) +
+                      " of sequences" );
+  }
+
+  std::cout << std::endl
+            << "Counting cost per query (" << stats.numCostQueries
+            << ( stats.numCostQueries == 1 ? " query" : " queries" )
+            << "):" << std::endl;
+  PrintStatsLine( "Kmers looked up", Number( stats.meanLookupsPerQuery, 1 ) );
+  PrintStatsLine( "Postings counted", Number( stats.meanCountingCost, 1 ) );
+  PrintStatsLine( "Counters reset", Number( stats.meanCountersReset, 1 ) );
+}
+
+template < typename A >
+bool DoIndexStats( const std::string& databasePath,
+                   const std::string& queryPath, const size_t wordSize,
+                   const DatabaseParams& databaseParams,
+                   const size_t          numTopKmers ) {
+  ProgressOutput progress;
+
+  enum ProgressType { LoadDB, ReadQueryFile };
+
+  bool isIndexFile = IndexFile::Reader::IsIndexFile( databasePath );
+  if( isIndexFile ) {
+    progress.Add( ProgressType::LoadDB, "Load database index" );
+  } else {
+    AddDatabaseProgressStages( &progress );
+  }
+  if( !queryPath.empty() ) {
+    progress.Add( ProgressType::ReadQueryFile, "Read queries",
+                  UnitType::BYTES );
+  }
+
+  Database< A > db( wordSize, databaseParams );
+  if( isIndexFile ) {
+    progress.Activate( ProgressType::LoadDB );
+    // Inspecting the index reads all of it anyway
+    if( !db.Load( databasePath, true ) ) {
+      std::cerr << std::endl
+                << "Invalid or incompatible database index " << databasePath
+                << std::endl;
+      return false;
+    }
+    progress.Set( ProgressType::LoadDB, 1, 1 );
+  } else {
+    BuildDatabase( databasePath, &db, &progress );
+  }
+
+  IndexStats< A > stats( db, numTopKmers );
+
+  if( !queryPath.empty() ) {
+    auto qryReader =
+      DetectFileFormatAndOpenReader< A >( queryPath, FileFormat::FASTA );
+
+    Sequence< A >     query;
+    SequenceList< A > queries;
+    progress.Activate( ProgressType::ReadQueryFile );
+    while( !qryReader->EndOfFile() ) {
+      ( *qryReader ) >> query;
+      queries.push_back( std::move( query ) );
+      progress.Set( ProgressType::ReadQueryFile, qryReader->NumBytesRead(),
+                    qryReader->NumBytesTotal() );
+    }
+    stats.MeasureCountingCost( queries );
+  }
+
+  PrintIndexStats( db, stats );
+  return true;
+}
+
+// Explicit instantiation
+template bool DoIndexStats< DNA >( const std::string&, const std::string&,
+                                   const size_t, const DatabaseParams&,
+                                   const size_t );
+template bool DoIndexStats< Protein >( const std::string&, const std::string&,
+                                       const size_t, const DatabaseParams&,
+                                       const size_t );
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <nsearch/Database.h>
+
+#include <string>
+
+// Print what the index of the database consists of. The counting cost
+// is measured on the queries, if given (on database sequences otherwise).
+template < typename Alphabet >
+extern bool DoIndexStats( const std::string&    databasePath,
+                          const std::string&    queryPath,
+                          const size_t          wordSize,
+                          const DatabaseParams& databaseParams,
+                          const size_t          numTopKmers );
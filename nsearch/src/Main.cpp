@@ -2,6 +2,7 @@
 #include <functional>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
 #include <utility>
 
 #include <nsearch/FASTA/Reader.h>
@@ -9,8 +10,11 @@
 #include <nsearch/Alphabet/DNA.h>
 #include <nsearch/Alphabet/Protein.h>
 
+#include "BuildDatabase.h"
 #include "Common.h"
 #include "Filter.h"
+#include "Index.h"
+#include "IndexStats.h"
 #include "Merge.h"
 #include "Search.h"
 #include "Stats.h"
@@ -21,17 +25,34 @@ static const char USAGE[] = R"(
   Metagenomics tool for the rest of us.
 
   Usage:
-    nsearch search --query=<queryfile> --db=<databasefile>
-      --out=<outputfile> --min-identity=<minidentity> [--max-hits=<maxaccepts>] [--max-rejects=<maxrejects>] [--protein] [--strand=<strand>]
+    nsearch search --query=<queryfile> (--db=<databasefile> --out=<outputfile>)...
+      --min-identity=<minidentity> [--max-hits=<maxaccepts>] [--max-rejects=<maxrejects>] [--protein] [--strand=<strand>] [--word-size=<wordsize>] [--seed=<seedmask>] [--compress-postings] [--canonical-kmers] [--minimizer-window=<window>] [--max-kmer-frequency=<freq>] [--dust] [--collapse-duplicates] [--prune-by-length] [--cluster-sequences] [--huge-pages] [--numa-interleave] [--max-memory=<bytes>]
+    nsearch index --db=<databasefile> --out=<indexfile> [--protein] [--word-size=<wordsize>] [--seed=<seedmask>] [--compress-postings] [--canonical-kmers] [--minimizer-window=<window>] [--max-kmer-frequency=<freq>] [--dust] [--collapse-duplicates] [--prune-by-length] [--cluster-sequences] [--huge-pages] [--numa-interleave]
+    nsearch index-stats --db=<databasefile> [--query=<queryfile>] [--top-kmers=<n>] [--protein] [--word-size=<wordsize>] [--seed=<seedmask>] [--compress-postings] [--canonical-kmers] [--minimizer-window=<window>] [--max-kmer-frequency=<freq>] [--dust] [--collapse-duplicates] [--prune-by-length] [--cluster-sequences]
     nsearch merge --forward=<forwardfile> --reverse=<reversefile> --out=<outputfile>
     nsearch filter --in=<inputfile> --out=<outputfile> [--max-expected-errors=<maxee>]
 
   Options:
+    --db=<databasefile>             FASTA/FASTQ file, or an index file created with nsearch index (which fixes the word size, seed and other index options). Search takes several, each followed by the --out its hits are written to, and reads the queries only once for all of them.
     --min-identity=<minidentity>    Minimum identity threshold (e.g. 0.8).
     --max-hits=<maxaccepts>         Maximum number of successful hits reported for one query [default: 1].
     --max-rejects=<maxrejects>      Abort after this many candidates were rejected [default: 16].
     --max-expected-errors=<maxee>   Maximum number of expected errors [default: 1.0].
     --strand=<strand>               Strand to search on (plus, minus or both). If minus (or both), queries are reverse complemented [default: both].
+    --word-size=<wordsize>          Length of the words (kmers) used to index the database, 0 for the default (8 for DNA, 5 for protein). Longer words (up to 31 for DNA and 15 for protein) keep lookups fast on large databases [default: 0].
+    --seed=<seedmask>               Spaced seed used instead of contiguous words, e.g. 11011011 (1: position is part of the word). Replaces --word-size.
+    --compress-postings             Store the database index compressed (postings take 5-7x less memory, but counting them is 1.5-2.5x slower, most noticeable with short words).
+    --canonical-kmers               Index each word together with its reverse complement, so both strands are counted in one pass (DNA only, seed must read the same backwards).
+    --minimizer-window=<window>     Only index the minimizer of every window of this many consecutive words, 0 to index every word. Shrinks the index by roughly half the window [default: 0].
+    --max-kmer-frequency=<freq>     Drop words found in more than this fraction of the database sequences from the index (e.g. 0.5), 0 to keep all [default: 0].
+    --dust                          Mask low-complexity regions (e.g. ATATATATATA) of database and queries, so they are neither indexed nor used as seeds (DNA only).
+    --collapse-duplicates           Index identical database sequences only once. Hits are reported for each of them, without counting towards --max-hits.
+    --prune-by-length               Order the database by length, and skip sequences whose length differs too much from the query's to reach --min-identity (terminal gaps aside, which don't count towards identity).
+    --cluster-sequences             Number the database sequences so that similar ones are next to each other (by MinHash sketch), which keeps hit counting cache friendly on large databases. Not with --prune-by-length.
+    --huge-pages                    Back the database index with huge pages (reserved ones if available, transparent ones otherwise), fewer TLB misses on large databases.
+    --numa-interleave               Spread the database index across all NUMA nodes, so searching threads on all sockets share the memory bandwidth.
+    --top-kmers=<n>                 Number of most frequent words listed by index-stats [default: 10].
+    --max-memory=<bytes>            Memory for searching FASTA/FASTQ databases (e.g. 512M or 8G), 0 for no limit. Half of it goes to the index of a database shard, shards are searched one after another; the other half to the queries and their hits, read in batches. Index files are memory-mapped and searched as a whole [default: 0].
 )";
 
 void PrintSummaryHeader() {
@@ -54,6 +75,13 @@ void PrintSummaryLine( const float value, const std::string& line,
 
 using Args = std::map< std::string, docopt::value > ;
 
+// Search takes a list of --db and --out, the other commands a single one
+std::string SingleArg( const Args& args, const std::string& name ) {
+  const auto& value = args.at( name );
+  return value.isStringList() ? value.asStringList().front()
+                              : value.asString();
+}
+
 template < typename A >
 void AddSpecialSearchParams( const Args& args, SearchParams< A >* sp ) {}
 
@@ -75,11 +103,175 @@ SearchParams< A > ParseSearchParams( const Args& args ) {
   sp.maxAccepts  = args.at( "--max-hits" ).asLong();
   sp.maxRejects  = args.at( "--max-rejects" ).asLong();
 
+  if( args.at( "--prune-by-length" ).asBool() ) {
+    sp.minLengthRatio = sp.minIdentity;
+  }
+
   AddSpecialSearchParams( args, &sp );
 
   return sp;
 }
 
+template < typename A >
+size_t ParseWordSize( const Args& args ) {
+  long wordSize = args.at( "--word-size" ).asLong();
+  if( wordSize <= 0 )
+    return WordSize< A >::VALUE;
+
+  return std::min< size_t >( wordSize, MaxKmerLength< A >() );
+}
+
+DatabaseParams ParseDatabaseParams( const Args& args ) {
+  DatabaseParams dp;
+
+  dp.compressPostings = args.at( "--compress-postings" ).asBool();
+  dp.canonicalKmers   = args.at( "--canonical-kmers" ).asBool();
+  dp.minimizerWindow =
+    std::max< long >( 0, args.at( "--minimizer-window" ).asLong() );
+  dp.maxKmerFrequency =
+    std::stod( args.at( "--max-kmer-frequency" ).asString() );
+  dp.dustMask           = args.at( "--dust" ).asBool();
+  dp.collapseDuplicates = args.at( "--collapse-duplicates" ).asBool();
+  dp.sortByLength       = args.at( "--prune-by-length" ).asBool();
+  dp.clusterSequences   = args.at( "--cluster-sequences" ).asBool();
+  if( args.at( "--seed" ) ) {
+    dp.seedMask = args.at( "--seed" ).asString();
+  }
+
+  return dp;
+}
+
+IndexMemoryPolicy ParseIndexMemoryPolicy( const Args& args ) {
+  IndexMemoryPolicy policy;
+
+  policy.hugePages         = args.at( "--huge-pages" ).asBool();
+  policy.reservedHugePages = policy.hugePages;
+  policy.interleave        = args.at( "--numa-interleave" ).asBool();
+
+  return policy;
+}
+
+template < typename A >
+bool CheckDatabaseParams( const DatabaseParams& dp ) {
+  if( !dp.seedMask.empty() && ( !SeedMask::IsValid( dp.seedMask ) ||
+                                dp.seedMask.size() > MaxKmerLength< A >() ) ) {
+    std::cerr << "Invalid seed " << dp.seedMask
+              << " (0s and 1s, starting and ending with 1, at most "
+              << MaxKmerLength< A >() << " long)" << std::endl;
+    return false;
+  }
+
+  if( dp.dustMask && !std::is_same< A, DNA >::value ) {
+    std::cerr << "Masking low-complexity regions is supported for DNA only"
+              << std::endl;
+    return false;
+  }
+
+  if( dp.sortByLength && dp.clusterSequences ) {
+    std::cerr << "Sequences can either be ordered by length or clustered"
+              << std::endl;
+    return false;
+  }
+
+  if( dp.canonicalKmers &&
+      ( !KmerComplementPolicy< A >::HasComplement ||
+        !( dp.seedMask.empty() || SeedMask( dp.seedMask ).IsSymmetric() ) ) ) {
+    std::cerr << "Canonical kmers need DNA and a seed which reads the same "
+                 "backwards"
+              << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// An index file fixes the database options it was built with. Options left
+// at their default take the index's values, ones given have to match them.
+template < typename A >
+bool CheckIndexParams( const Args&                       args,
+                       const std::vector< std::string >& databasePaths ) {
+  const DatabaseParams dp = ParseDatabaseParams( args );
+
+  for( auto& databasePath : databasePaths ) {
+    size_t         kmerLength;
+    DatabaseParams ip;
+    // Not an index, or an invalid one (reported when loading it)
+    if( !IndexFile::Reader::IsIndexFile( databasePath ) ||
+        !Database< A >::LoadParams( databasePath, &kmerLength, &ip ) )
+      continue;
+
+    std::vector< std::string > mismatches;
+    auto check = [&]( const bool differs, const std::string& given,
+                      const std::string& indexed ) {
+      if( differs ) {
+        mismatches.push_back( given + " (index: " + indexed + ")" );
+      }
+    };
+    auto flag = [&]( const bool given, const bool indexed,
+                     const std::string& option ) {
+      check( given && !indexed, option, "not set" );
+    };
+
+    const SeedMask indexSeed( ip.seedMask );
+    const std::string indexWords =
+      indexSeed.IsContiguous() ? "--word-size=" + std::to_string( kmerLength )
+                               : "--seed=" + ip.seedMask;
+    if( args.at( "--seed" ) ) {
+      check( SeedMask( dp.seedMask ).ToString() != ip.seedMask,
+             "--seed=" + dp.seedMask, indexWords );
+    } else if( args.at( "--word-size" ).asLong() > 0 ) {
+      const size_t wordSize = ParseWordSize< A >( args );
+      check( SeedMask( wordSize ).ToString() != ip.seedMask,
+             "--word-size=" + std::to_string( wordSize ), indexWords );
+    }
+
+    flag( dp.compressPostings, ip.compressPostings, "--compress-postings" );
+    flag( dp.canonicalKmers, ip.canonicalKmers, "--canonical-kmers" );
+    check( dp.minimizerWindow > 0 &&
+             dp.minimizerWindow != ip.minimizerWindow,
+           "--minimizer-window=" + std::to_string( dp.minimizerWindow ),
+           "--minimizer-window=" + std::to_string( ip.minimizerWindow ) );
+    std::ostringstream indexFrequency;
+    indexFrequency << "--max-kmer-frequency=" << ip.maxKmerFrequency;
+    check( dp.maxKmerFrequency > 0.0 &&
+             dp.maxKmerFrequency != ip.maxKmerFrequency,
+           "--max-kmer-frequency=" +
+             args.at( "--max-kmer-frequency" ).asString(),
+           indexFrequency.str() );
+    flag( dp.dustMask, ip.dustMask, "--dust" );
+    flag( dp.collapseDuplicates, ip.collapseDuplicates,
+          "--collapse-duplicates" );
+    flag( dp.clusterSequences, ip.clusterSequences, "--cluster-sequences" );
+
+    if( !mismatches.empty() ) {
+      std::cerr << "Database index " << databasePath
+                << " was built with other options:" << std::endl;
+      for( auto& mismatch : mismatches ) {
+        std::cerr << "  " << mismatch << std::endl;
+      }
+      std::cerr << "Leave them out to use the index's, or rebuild the index"
+                << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Number of bytes, with an optional K, M or G suffix (powers of 1024)
+size_t ParseMemorySize( const std::string& str ) {
+  size_t pos;
+  double value = std::stod( str, &pos );
+
+  const std::string units = "KMG";
+  auto unit = pos < str.size() ? units.find( toupper( str[ pos ] ) )
+                               : std::string::npos;
+  if( unit != std::string::npos ) {
+    value *= double( size_t( 1 ) << ( 10 * ( unit + 1 ) ) );
+  }
+  return value > 0.0 ? size_t( value ) : 0;
+}
+
 int main( int argc, const char** argv ) {
   Args args = docopt::docopt( USAGE, { argv + 1, argv + argc },
                               true, // help
@@ -93,29 +285,106 @@ int main( int argc, const char** argv ) {
   if( args[ "search" ].asBool() ) {
     gStats.StartTimer();
 
-    auto query      = args[ "--query" ].asString();
-    auto db         = args[ "--db" ].asString();
-    auto out        = args[ "--out" ].asString();
+    auto query = args[ "--query" ].asString();
+    auto dbs   = args[ "--db" ].asStringList();
+    auto outs  = args[ "--out" ].asStringList();
+    if( dbs.size() != outs.size() ) {
+      std::cerr << "Each --db needs an --out" << std::endl;
+      return 1;
+    }
+
+    auto dbParams  = ParseDatabaseParams( args );
+    auto maxMemory = ParseMemorySize( args[ "--max-memory" ].asString() );
+    IndexMemory::SetPolicy( ParseIndexMemoryPolicy( args ) );
+
+    bool success;
+    if( args[ "--protein" ].asBool() ) {
+      success = CheckDatabaseParams< Protein >( dbParams ) &&
+                CheckIndexParams< Protein >( args, dbs ) &&
+                DoSearch< Protein >( query, dbs, outs,
+                                     ParseSearchParams< Protein >( args ),
+                                     ParseWordSize< Protein >( args ),
+                                     dbParams, maxMemory );
+    } else {
+      success = CheckDatabaseParams< DNA >( dbParams ) &&
+                CheckIndexParams< DNA >( args, dbs ) &&
+                DoSearch< DNA >( query, dbs, outs,
+                                 ParseSearchParams< DNA >( args ),
+                                 ParseWordSize< DNA >( args ), dbParams,
+                                 maxMemory );
+    }
+
+    gStats.StopTimer();
+
+    if( !success )
+      return 1;
+
+    PrintSummaryHeader();
+    PrintSummaryLine( gStats.ElapsedMillis() / 1000.0, "Seconds" );
+  }
+
+  // Index
+  if( args[ "index" ].asBool() ) {
+    gStats.StartTimer();
+
+    auto db  = SingleArg( args, "--db" );
+    auto out = SingleArg( args, "--out" );
 
+    auto dbParams = ParseDatabaseParams( args );
+    IndexMemory::SetPolicy( ParseIndexMemoryPolicy( args ) );
 
+    bool success;
     if( args[ "--protein" ].asBool() ) {
-      DoSearch< Protein >( query, db, out, ParseSearchParams< Protein >( args ) );
+      success = CheckDatabaseParams< Protein >( dbParams ) &&
+                DoIndex< Protein >( db, out, ParseWordSize< Protein >( args ),
+                                    dbParams );
     } else {
-      DoSearch< DNA >( query, db, out, ParseSearchParams< DNA >( args ) );
+      success = CheckDatabaseParams< DNA >( dbParams ) &&
+                DoIndex< DNA >( db, out, ParseWordSize< DNA >( args ),
+                                dbParams );
     }
 
     gStats.StopTimer();
 
+    if( !success )
+      return 1;
+
     PrintSummaryHeader();
     PrintSummaryLine( gStats.ElapsedMillis() / 1000.0, "Seconds" );
   }
 
+  // Index statistics
+  if( args[ "index-stats" ].asBool() ) {
+    auto db    = SingleArg( args, "--db" );
+    auto query = args[ "--query" ] ? args[ "--query" ].asString() : "";
+    auto numTopKmers = std::max< long >( 0, args[ "--top-kmers" ].asLong() );
+
+    auto dbParams = ParseDatabaseParams( args );
+
+    bool success;
+    if( args[ "--protein" ].asBool() ) {
+      success = CheckDatabaseParams< Protein >( dbParams ) &&
+                CheckIndexParams< Protein >( args, { db } ) &&
+                DoIndexStats< Protein >( db, query,
+                                         ParseWordSize< Protein >( args ),
+                                         dbParams, numTopKmers );
+    } else {
+      success = CheckDatabaseParams< DNA >( dbParams ) &&
+                CheckIndexParams< DNA >( args, { db } ) &&
+                DoIndexStats< DNA >( db, query, ParseWordSize< DNA >( args ),
+                                     dbParams, numTopKmers );
+    }
+
+    if( !success )
+      return 1;
+  }
+
   // Merge
   if( args[ "merge" ].asBool() ) {
     gStats.StartTimer();
 
     DoMerge( args[ "--forward" ].asString(), args[ "--reverse" ].asString(),
-           args[ "--out" ].asString() );
+           SingleArg( args, "--out" ) );
 
     gStats.StopTimer();
 
@@ -133,7 +402,7 @@ int main( int argc, const char** argv ) {
     gStats.StartTimer();
 
     auto in    = args[ "--in" ].asString();
-    auto out   = args[ "--out" ].asString();
+    auto out   = SingleArg( args, "--out" );
     auto maxee = std::stof( args[ "--max-expected-errors" ].asString() );
 
     DoFilter( in, out, maxee );
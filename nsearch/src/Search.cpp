@@ -7,8 +7,14 @@
 #include <nsearch/Alphabet/DNA.h>
 #include <nsearch/Alphabet/Protein.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <memory>
+#include <numeric>
+#include <vector>
 
+#include "BuildDatabase.h"
 #include "Common.h"
 #include "FileFormat.h"
 #include "WorkerQueue.h"
@@ -59,121 +65,400 @@ public:
   }
 };
 
+template < typename A >
+using SearchResultsWriterList =
+  std::vector< std::unique_ptr< SearchResultsWriter< A > > >;
+
+template < typename A >
+using DatabaseList = std::vector< std::unique_ptr< Database< A > > >;
+
+// Searches each batch of queries against all databases, the hits
+// against database i go to writer i
 template < typename A >
 class QueryDatabaseSearcherWorker {
 public:
-  QueryDatabaseSearcherWorker( SearchResultsWriter< A >* writer,
-                               const Database< A >*      database,
-                               const SearchParams< A > &params )
-      : mWriter( *writer ),
-        mGlobalSearch( *database, params ) {}
+  QueryDatabaseSearcherWorker( const SearchResultsWriterList< A >* writers,
+                               const DatabaseList< A >*            databases,
+                               const SearchParams< A >&            params )
+      : mWriters( *writers ) {
+    for( auto& database : *databases ) {
+      mGlobalSearches.emplace_back(
+        new GlobalSearch< A >( *database, params ) );
+    }
+  }
 
   void Process( const SequenceList< A >& queries ) {
-    QueryWithHitsList< A > list;
+    // One database after the other, so its index stays in cache
+    // for the whole batch
+    for( size_t index = 0; index < mGlobalSearches.size(); index++ ) {
+      QueryWithHitsList< A > list;
 
-    for( auto& query : queries ) {
-      auto hits = mGlobalSearch.Query( query );
-      if( hits.empty() )
-        continue;
+      for( auto& query : queries ) {
+        auto hits = mGlobalSearches[ index ]->Query( query );
+        if( hits.empty() )
+          continue;
 
-      list.push_back( { query, hits } );
-    }
+        list.push_back( { query, std::move( hits ) } );
+      }
 
-    if( !list.empty() ) {
-      mWriter.Enqueue( list );
+      if( !list.empty() ) {
+        mWriters[ index ]->Enqueue( list );
+      }
     }
   }
 
 private:
-  GlobalSearch< A >         mGlobalSearch;
-  SearchResultsWriter< A >& mWriter;
+  std::vector< std::unique_ptr< GlobalSearch< A > > > mGlobalSearches;
+  const SearchResultsWriterList< A >&                 mWriters;
 };
 
 template < typename A >
 using QueryDatabaseSearcher =
   WorkerQueue< QueryDatabaseSearcherWorker< A >, SequenceList< A >,
-               SearchResultsWriter< A >*, const Database< A >*,
+               const SearchResultsWriterList< A >*, const DatabaseList< A >*,
                const SearchParams< A >& >;
 
+// Range of queries [first, second)
+using QueryRange = std::pair< size_t, size_t >;
+
+template <>
+class QueueItemInfo< QueryRange > {
+public:
+  static size_t Count( const QueryRange& range ) {
+    return range.second - range.first;
+  }
+};
+
+// Searches one database shard, the hits of each query are merged
+// into the ones found in previous shards. Targets are kept by their
+// position in the database file (see HitById), the shard starts at
+// firstTargetId.
 template < typename A >
-struct WordSize {
-  static const int VALUE = 8; // DNA, default
+class QueryShardSearcherWorker {
+public:
+  QueryShardSearcherWorker( const SequenceList< A >*         queries,
+                            std::vector< HitByIdList< A > >* hits,
+                            const Database< A >*             database,
+                            const SequenceId                 firstTargetId,
+                            const SearchParams< A >&         params )
+      : mQueries( *queries ), mHits( *hits ),
+        mGlobalSearch( *database, params ), mFirstTargetId( firstTargetId ),
+        mMaxAccepts( params.maxAccepts ),
+        mCollapseDuplicates( database->Params().collapseDuplicates ) {}
+
+  void Process( const QueryRange& range ) {
+    // Ranges are disjoint, so each query is only touched by one worker
+    for( size_t index = range.first; index < range.second; index++ ) {
+      auto hits = mGlobalSearch.QueryById( mQueries[ index ] );
+      for( auto& hit : hits ) {
+        hit.targetId += mFirstTargetId;
+      }
+      MergeHits( hits, mMaxAccepts, mCollapseDuplicates, &mHits[ index ] );
+    }
+  }
+
+private:
+  const SequenceList< A >&         mQueries;
+  std::vector< HitByIdList< A > >& mHits;
+  GlobalSearch< A >                mGlobalSearch;
+  SequenceId                       mFirstTargetId;
+  int                              mMaxAccepts;
+  bool                             mCollapseDuplicates;
 };
 
+template < typename A >
+using QueryShardSearcher =
+  WorkerQueue< QueryShardSearcherWorker< A >, QueryRange,
+               const SequenceList< A >*, std::vector< HitByIdList< A > >*,
+               const Database< A >*, const SequenceId,
+               const SearchParams< A >& >;
+
+// Bytes a query of a sharded search takes until its hits are written:
+// the query, at most maxAccepts hits per strand (collapsed duplicates
+// aside) and their targets, which are about as long as the query (global
+// alignment). Targets are read back once, and copied into each hit written.
+template < typename A >
+size_t EstimateQueryMemoryUsage( const Sequence< A >&     query,
+                                 const SearchParams< A >& params ) {
+  // Same as a database sequence, see DatabaseShardReader
+  const size_t seqBytes = sizeof( Sequence< A > ) + query.Length() * 2 +
+                          query.identifier.size();
+
+  // A Cigar (deque) takes a node of 512 bytes and its map at least
+  const size_t hitBytes = sizeof( HitById< A > ) + 512 + 64;
+  return seqBytes + 2 * params.maxAccepts * ( hitBytes + 2 * seqBytes );
+}
+
+template < typename A >
+inline Hit< A > HitWithTarget( const HitById< A >&  hit,
+                               const Sequence< A >& target ) {
+  return { target, hit.alignment, hit.duplicate };
+}
+
 template <>
-struct WordSize< Protein > {
-  static const int VALUE = 5;
-};
+inline Hit< DNA > HitWithTarget( const HitById< DNA >&  hit,
+                                 const Sequence< DNA >& target ) {
+  return { target, hit.alignment, hit.strand, hit.duplicate };
+}
 
+// Writes the hits of a batch of queries (in query order), freeing them.
+// Only the targets hit are read back from the database file.
 template < typename A >
-bool DoSearch( const std::string& queryPath, const std::string& databasePath,
-               const std::string&       outputPath,
-               const SearchParams< A >& searchParams ) {
-  ProgressOutput progress;
+void WriteHitsById( const std::string&               databasePath,
+                    const SequenceList< A >&         queries,
+                    std::vector< HitByIdList< A > >* hits,
+                    SearchResultsWriter< A >*        writer,
+                    const size_t                     numQueriesPerWorkItem,
+                    ProgressOutput*                  progress ) {
+  std::vector< SequenceId > targetIds;
+  for( auto& queryHits : *hits ) {
+    for( auto& hit : queryHits ) {
+      targetIds.push_back( hit.targetId );
+    }
+  }
+  std::sort( targetIds.begin(), targetIds.end() );
+  targetIds.erase( std::unique( targetIds.begin(), targetIds.end() ),
+                   targetIds.end() );
+
+  auto dbReader =
+    DetectFileFormatAndOpenReader< A >( databasePath, FileFormat::FASTA );
 
+  SequenceList< A > targets;
   Sequence< A >     seq;
-  SequenceList< A > sequences;
-
-  auto dbReader = DetectFileFormatAndOpenReader< A >( databasePath, FileFormat::FASTA );
-
-  enum ProgressType {
-    ReadDBFile,
-    StatsDB,
-    IndexDB,
-    ReadQueryFile,
-    SearchDB,
-    WriteHits
-  };
-
-  progress.Add( ProgressType::ReadDBFile, "Read database", UnitType::BYTES );
-  progress.Add( ProgressType::StatsDB, "Analyze database" );
-  progress.Add( ProgressType::IndexDB, "Index database" );
+  SequenceId        seqId = 0;
+  progress->Activate( DatabaseProgressType::ReadDBFile );
+  while( targets.size() < targetIds.size() && !dbReader->EndOfFile() ) {
+    ( *dbReader ) >> seq;
+    if( seqId++ == targetIds[ targets.size() ] ) {
+      targets.push_back( std::move( seq ) );
+    }
+    progress->Set( DatabaseProgressType::ReadDBFile, dbReader->NumBytesRead(),
+                   dbReader->NumBytesTotal() );
+  }
+  assert( targets.size() == targetIds.size() );
+
+  QueryWithHitsList< A > list;
+  for( size_t index = 0; index < queries.size(); index++ ) {
+    HitByIdList< A >& queryHits = ( *hits )[ index ];
+    if( !queryHits.empty() ) {
+      HitList< A > withTargets;
+      for( auto& hit : queryHits ) {
+        size_t target =
+          std::lower_bound( targetIds.begin(), targetIds.end(),
+                            hit.targetId ) -
+          targetIds.begin();
+        withTargets.push_back( HitWithTarget( hit, targets[ target ] ) );
+      }
+      HitByIdList< A >().swap( queryHits );
+      list.push_back( { queries[ index ], std::move( withTargets ) } );
+    }
+
+    if( list.size() >= numQueriesPerWorkItem ||
+        ( index + 1 == queries.size() && !list.empty() ) ) {
+      writer->Enqueue( list );
+      list.clear();
+    }
+  }
+  writer->WaitTillDone();
+}
+
+// Each database is indexed and searched one shard at a time. Half of
+// maxMemory goes to the index of a shard, the other half to a batch of
+// queries and their hits (see EstimateQueryMemoryUsage). Hits are kept by
+// target id until all shards of a database are done. If the queries take
+// more than one batch, each batch is searched against all shards anew.
+template < typename A >
+bool DoShardedSearch( const std::string&                queryPath,
+                      const std::vector< std::string >& databasePaths,
+                      const std::vector< std::string >& outputPaths,
+                      const SearchParams< A >&          searchParams,
+                      const size_t                      wordSize,
+                      const DatabaseParams&             databaseParams,
+                      const size_t                      maxMemory ) {
+  const size_t shardMemory = maxMemory / 2;
+  const size_t queryMemory = maxMemory - shardMemory;
+
+  // Each shard has an index of its own, with a fixed overhead
+  Database< A > estimator( wordSize, databaseParams );
+  const size_t  minMemory = 2 * estimator.EstimateMemoryUsage( 0, 0, 0 );
+  if( shardMemory < minMemory ) {
+    std::cerr << "Memory limit too low, need at least "
+              << ValueWithUnit( 2 * minMemory, UnitType::BYTES ) << std::endl;
+    return false;
+  }
+
+  ProgressOutput progress;
+
+  enum ProgressType { ReadQueryFile, SearchDB, WriteHits };
+
+  progress.Add( ProgressType::ReadQueryFile, "Read queries", UnitType::BYTES );
+  AddDatabaseProgressStages( &progress );
+  progress.Add( ProgressType::SearchDB, "Search database" );
+  progress.Add( ProgressType::WriteHits, "Write hits" );
+
+  const size_t numQueriesPerWorkItem = 64;
+
+  SearchResultsWriterList< A > writers;
+  for( auto& outputPath : outputPaths ) {
+    writers.emplace_back( new SearchResultsWriter< A >( 1, outputPath ) );
+    writers.back()->OnProcessed(
+      [&]( size_t numProcessed, size_t numEnqueued ) {
+        progress.Set( ProgressType::WriteHits, numProcessed, numEnqueued );
+      } );
+  }
+
+  auto qryReader =
+    DetectFileFormatAndOpenReader< A >( queryPath, FileFormat::FASTA );
+
+  SequenceList< A > queries;
+  Sequence< A >     pending;
+  bool              hasPending = false;
+  while( hasPending || !qryReader->EndOfFile() ) {
+    // Next batch, at least one query
+    queries.clear();
+    size_t batchBytes = 0;
+    progress.Activate( ProgressType::ReadQueryFile );
+    while( hasPending || !qryReader->EndOfFile() ) {
+      if( !hasPending ) {
+        ( *qryReader ) >> pending;
+        hasPending = true;
+      }
+
+      size_t bytes = EstimateQueryMemoryUsage( pending, searchParams );
+      if( !queries.empty() && batchBytes + bytes > queryMemory )
+        break;
+
+      batchBytes += bytes;
+      queries.push_back( std::move( pending ) );
+      hasPending = false;
+      progress.Set( ProgressType::ReadQueryFile, qryReader->NumBytesRead(),
+                    qryReader->NumBytesTotal() );
+    }
+
+    for( size_t dbIndex = 0; dbIndex < databasePaths.size(); dbIndex++ ) {
+      std::vector< HitByIdList< A > > hits( queries.size() );
+
+      DatabaseShardReader< A > shardReader( databasePaths[ dbIndex ],
+                                            estimator, shardMemory );
+
+      SequenceList< A > sequences;
+      SequenceId        firstTargetId = 0;
+      while( !shardReader.EndOfFile() ) {
+        shardReader.Read( &sequences, &progress );
+        const size_t numSequences = sequences.size();
+
+        Database< A > db( wordSize, databaseParams );
+        IndexDatabase( std::move( sequences ), &db, &progress );
+
+        QueryShardSearcher< A > searcher( -1, &queries, &hits, &db,
+                                          firstTargetId, searchParams );
+        searcher.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
+          progress.Set( ProgressType::SearchDB, numProcessed, numEnqueued );
+        } );
+
+        progress.Activate( ProgressType::SearchDB );
+        for( size_t first = 0; first < queries.size();
+             first += numQueriesPerWorkItem ) {
+          QueryRange range( first, std::min( queries.size(),
+                                             first + numQueriesPerWorkItem ) );
+          searcher.Enqueue( range );
+        }
+        searcher.WaitTillDone();
+
+        firstTargetId += numSequences;
+      }
+
+      progress.Activate( ProgressType::WriteHits );
+      WriteHitsById( databasePaths[ dbIndex ], queries, &hits,
+                     writers[ dbIndex ].get(), numQueriesPerWorkItem,
+                     &progress );
+    }
+  }
+
+  return true;
+}
+
+// Each database is searched as a whole, built in memory (FASTA/FASTQ)
+// or loaded (index file)
+template < typename A >
+bool DoUnshardedSearch( const std::string&                queryPath,
+                        const std::vector< std::string >& databasePaths,
+                        const std::vector< std::string >& outputPaths,
+                        const SearchParams< A >&          searchParams,
+                        const size_t                      wordSize,
+                        const DatabaseParams&             databaseParams ) {
+  std::vector< bool > isIndexFile;
+  bool                anyIndexFile = false;
+  for( auto& databasePath : databasePaths ) {
+    isIndexFile.push_back( IndexFile::Reader::IsIndexFile( databasePath ) );
+    anyIndexFile = anyIndexFile || isIndexFile.back();
+  }
+
+  ProgressOutput progress;
+
+  enum ProgressType { LoadDB, ReadQueryFile, SearchDB, WriteHits };
+
+  if( anyIndexFile ) {
+    progress.Add( ProgressType::LoadDB, "Load database index" );
+  }
+  if( std::find( isIndexFile.begin(), isIndexFile.end(), false ) !=
+      isIndexFile.end() ) {
+    AddDatabaseProgressStages( &progress );
+  }
   progress.Add( ProgressType::ReadQueryFile, "Read queries", UnitType::BYTES );
   progress.Add( ProgressType::SearchDB, "Search database" );
   progress.Add( ProgressType::WriteHits, "Write hits" );
 
-  // Read DB
-  progress.Activate( ProgressType::ReadDBFile );
-  while( !dbReader->EndOfFile() ) {
-    (*dbReader) >> seq;
-    sequences.push_back( std::move( seq ) );
-    progress.Set( ProgressType::ReadDBFile, dbReader->NumBytesRead(),
-                  dbReader->NumBytesTotal() );
-  }
-
-  // Index DB
-  Database< A > db( WordSize< A >::VALUE );
-  db.SetProgressCallback(
-    [&]( typename Database< A >::ProgressType type, size_t num, size_t total ) {
-      switch( type ) {
-        case Database< A >::ProgressType::StatsCollection:
-          progress.Activate( ProgressType::StatsDB )
-            .Set( ProgressType::StatsDB, num, total );
-          break;
-
-        case Database< A >::ProgressType::Indexing:
-          progress.Activate( ProgressType::IndexDB )
-            .Set( ProgressType::IndexDB, num, total );
-          break;
-
-        default:
-          break;
+  DatabaseList< A > databases;
+  for( size_t index = 0; index < databasePaths.size(); index++ ) {
+    databases.emplace_back( new Database< A >( wordSize, databaseParams ) );
+    Database< A >& db = *databases.back();
+
+    if( isIndexFile[ index ] ) {
+      progress.Activate( ProgressType::LoadDB );
+      if( !db.Load( databasePaths[ index ] ) ) {
+        std::cerr << std::endl
+                  << "Invalid or incompatible database index "
+                  << databasePaths[ index ] << std::endl;
+        return false;
       }
-    } );
-  db.Initialize( sequences );
+      progress.Set( ProgressType::LoadDB, 1, 1 );
+    } else {
+      BuildDatabase( databasePaths[ index ], &db, &progress );
+    }
+  }
 
-  // Read and process queries
+  // Read and process queries (once for all databases)
   const int numQueriesPerWorkItem = 64;
 
-  SearchResultsWriter< A >   writer( 1, outputPath );
-  QueryDatabaseSearcher< A > searcher( -1, &writer, &db, searchParams );
+  // Hits written by all writers
+  std::vector< std::atomic< size_t > > numWritten( outputPaths.size() ),
+    numToWrite( outputPaths.size() );
+
+  SearchResultsWriterList< A > writers;
+  for( size_t index = 0; index < outputPaths.size(); index++ ) {
+    writers.emplace_back(
+      new SearchResultsWriter< A >( 1, outputPaths[ index ] ) );
+    numWritten[ index ] = 0;
+    numToWrite[ index ] = 0;
+
+    writers.back()->OnProcessed(
+      [&, index]( size_t numProcessed, size_t numEnqueued ) {
+        numWritten[ index ] = numProcessed;
+        numToWrite[ index ] = numEnqueued;
+        progress.Set( ProgressType::WriteHits,
+                      std::accumulate( numWritten.begin(), numWritten.end(),
+                                       size_t( 0 ) ),
+                      std::accumulate( numToWrite.begin(), numToWrite.end(),
+                                       size_t( 0 ) ) );
+      } );
+  }
 
+  QueryDatabaseSearcher< A > searcher( -1, &writers, &databases,
+                                       searchParams );
   searcher.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
     progress.Set( ProgressType::SearchDB, numProcessed, numEnqueued );
   } );
-  writer.OnProcessed( [&]( size_t numProcessed, size_t numEnqueued ) {
-    progress.Set( ProgressType::WriteHits, numProcessed, numEnqueued );
-  } );
 
   auto qryReader = DetectFileFormatAndOpenReader< A >( queryPath, FileFormat::FASTA );
 
@@ -191,14 +476,65 @@ bool DoSearch( const std::string& queryPath, const std::string& databasePath,
   searcher.WaitTillDone();
 
   progress.Activate( ProgressType::WriteHits );
-  writer.WaitTillDone();
+  for( auto& writer : writers ) {
+    writer->WaitTillDone();
+  }
+
+  return true;
+}
+
+template < typename A >
+bool DoSearch( const std::string&                queryPath,
+               const std::vector< std::string >& databasePaths,
+               const std::vector< std::string >& outputPaths,
+               const SearchParams< A >&          searchParams,
+               const size_t                      wordSize,
+               const DatabaseParams&             databaseParams,
+               const size_t                      maxMemory ) {
+  assert( databasePaths.size() == outputPaths.size() );
+
+  if( maxMemory == 0 ) {
+    return DoUnshardedSearch( queryPath, databasePaths, outputPaths,
+                              searchParams, wordSize, databaseParams );
+  }
+
+  // FASTA/FASTQ databases are searched in shards which fit into maxMemory.
+  // An index file is memory-mapped (only pages in use are resident),
+  // so it is searched as a whole, after them.
+  std::vector< std::string > shardedPaths, shardedOutputPaths, indexPaths,
+    indexOutputPaths;
+  for( size_t index = 0; index < databasePaths.size(); index++ ) {
+    if( IndexFile::Reader::IsIndexFile( databasePaths[ index ] ) ) {
+      indexPaths.push_back( databasePaths[ index ] );
+      indexOutputPaths.push_back( outputPaths[ index ] );
+    } else {
+      shardedPaths.push_back( databasePaths[ index ] );
+      shardedOutputPaths.push_back( outputPaths[ index ] );
+    }
+  }
+
+  if( !shardedPaths.empty() &&
+      !DoShardedSearch( queryPath, shardedPaths, shardedOutputPaths,
+                        searchParams, wordSize, databaseParams, maxMemory ) )
+    return false;
+
+  if( !indexPaths.empty() &&
+      !DoUnshardedSearch( queryPath, indexPaths, indexOutputPaths,
+                          searchParams, wordSize, databaseParams ) )
+    return false;
 
   return true;
 }
 
 // Explicit instantiation
-template bool DoSearch< DNA >( const std::string&, const std::string&,
-                               const std::string&, const SearchParams< DNA >& );
-template bool DoSearch< Protein >( const std::string&, const std::string&,
-                                   const std::string&,
-                                   const SearchParams< Protein >& );
+template bool DoSearch< DNA >( const std::string&,
+                               const std::vector< std::string >&,
+                               const std::vector< std::string >&,
+                               const SearchParams< DNA >&, const size_t,
+                               const DatabaseParams&, const size_t );
+template bool DoSearch< Protein >( const std::string&,
+                                   const std::vector< std::string >&,
+                                   const std::vector< std::string >&,
+                                   const SearchParams< Protein >&,
+                                   const size_t, const DatabaseParams&,
+                                   const size_t );
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <nsearch/Database.h>
 #include <nsearch/Database/Search.h>
 
 #include <string>
+#include <vector>
 
+// Queries are read once and searched against every database,
+// the hits against databasePaths[ i ] are written to outputPaths[ i ]
 template < typename Alphabet >
-extern bool DoSearch( const std::string&              queryPath,
-                      const std::string&              databasePath,
-                      const std::string&              outputPath,
-                      const SearchParams< Alphabet >& searchParams );
+extern bool DoSearch( const std::string&                queryPath,
+                      const std::vector< std::string >& databasePaths,
+                      const std::vector< std::string >& outputPaths,
+                      const SearchParams< Alphabet >&   searchParams,
+                      const size_t                      wordSize,
+                      const DatabaseParams&             databaseParams,
+                      const size_t                      maxMemory = 0 );